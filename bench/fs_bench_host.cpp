@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../kernel/fs_bench.h"
+#include "../kernel/filesystem.h"
+
+// Kernel services the filesystem depends on
+extern "C" void terminal_write_string(const char* data) {
+    fputs(data, stdout);
+}
+
+extern "C" void serial_write_string(const char* data) {
+    fputs(data, stdout);
+}
+
+static uint64_t host_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+extern "C" uint64_t clock_ns(void) {
+    return host_now();
+}
+
+// The kernel version divides with divl
+extern "C" uint64_t clock_div_u64(uint64_t n, uint32_t d, uint32_t* remainder) {
+    if (remainder) {
+        *remainder = n % d;
+    }
+    return n / d;
+}
+
+extern "C" void* page_alloc(void) {
+    return aligned_alloc(FS_BLOCK_SIZE, FS_BLOCK_SIZE);
+}
+
+extern "C" void page_free(void* page) {
+    free(page);
+}
+
+static void host_print(const char* text) {
+    fputs(text, stdout);
+}
+
+int main() {
+    const struct fs_bench_env env = { host_now, "ns", host_print };
+
+    filesystem_init();
+    fs_bench_run(&env);
+    return 0;
+}
@@ -13,8 +13,8 @@ align 4
     dd FLAGS
     dd CHECKSUM
     dd 0, 0, 0, 0, 0     ; unused fields
-    dd 0                 ; graphics mode
-    dd 80, 25, 0        ; width, height, depth (text mode)
+    dd 0                 ; linear graphics mode
+    dd 1024, 768, 32     ; width, height, depth for the framebuffer console
 
 ; Allocate the initial stack
 section .bootstrap_stack, nobits
@@ -0,0 +1,161 @@
+#include "aio.h"
+#include "filesystem.h"
+#include "memory.h"
+#include "string.h"
+
+// Rings with published but unserviced submissions
+static struct io_ring* rings = nullptr;
+
+static inline uint32_t load_acquire(const uint32_t* p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void store_release(uint32_t* p, uint32_t v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+extern "C" int io_ring_init(struct io_ring* ring, uint32_t entries) {
+    if (!ring || entries == 0 || (entries & (entries - 1))) {
+        return -1;
+    }
+
+    ring->sq = (struct io_sqe*)malloc(entries * sizeof(struct io_sqe));
+    ring->cq = (struct io_cqe*)malloc(2 * entries * sizeof(struct io_cqe));
+    if (!ring->sq || !ring->cq) {
+        free(ring->sq);
+        free(ring->cq);
+        return -1;
+    }
+
+    ring->sq_entries = entries;
+    ring->cq_entries = 2 * entries;
+    ring->sq_prepared = ring->sq_head = ring->sq_tail = 0;
+    ring->cq_head = ring->cq_tail = 0;
+    ring->next = rings;
+    rings = ring;
+    return 0;
+}
+
+extern "C" void io_ring_destroy(struct io_ring* ring) {
+    for (struct io_ring** link = &rings; *link; link = &(*link)->next) {
+        if (*link == ring) {
+            *link = ring->next;
+            break;
+        }
+    }
+    free(ring->sq);
+    free(ring->cq);
+    ring->sq = nullptr;
+    ring->cq = nullptr;
+}
+
+extern "C" struct io_sqe* io_get_sqe(struct io_ring* ring) {
+    if (ring->sq_prepared - load_acquire(&ring->sq_head) >= ring->sq_entries) {
+        return nullptr;
+    }
+    struct io_sqe* sqe = &ring->sq[ring->sq_prepared & (ring->sq_entries - 1)];
+    ring->sq_prepared++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+extern "C" int io_submit(struct io_ring* ring) {
+    int submitted = ring->sq_prepared - ring->sq_tail;
+    store_release(&ring->sq_tail, ring->sq_prepared);
+    return submitted;
+}
+
+extern "C" struct io_cqe* io_peek_cqe(struct io_ring* ring) {
+    if (ring->cq_head == load_acquire(&ring->cq_tail)) {
+        return nullptr;
+    }
+    return &ring->cq[ring->cq_head & (ring->cq_entries - 1)];
+}
+
+extern "C" void io_cqe_seen(struct io_ring* ring) {
+    store_release(&ring->cq_head, ring->cq_head + 1);
+}
+
+extern "C" struct io_cqe* io_wait_cqe(struct io_ring* ring) {
+    struct io_cqe* cqe;
+    while (!(cqe = io_peek_cqe(ring))) {
+        if (ring->sq_tail == ring->sq_head) {
+            return nullptr;  // Nothing in flight
+        }
+        aio_poll();
+    }
+    return cqe;
+}
+
+// Service up to AIO_BATCH submissions from one ring. Consecutive requests
+// for the same file share a single lookup.
+static void service_ring(struct io_ring* ring) {
+    uint32_t head = ring->sq_head;
+    uint32_t tail = load_acquire(&ring->sq_tail);
+    uint32_t cq_tail = ring->cq_tail;
+    uint32_t cq_head = load_acquire(&ring->cq_head);
+    const char* cached_name = nullptr;
+    struct File* cached_file = nullptr;
+
+    for (uint32_t n = 0; n < AIO_BATCH && head != tail; n++) {
+        if (cq_tail - cq_head >= ring->cq_entries) {
+            break;  // Wait for the caller to drain completions
+        }
+
+        const struct io_sqe* sqe = &ring->sq[head & (ring->sq_entries - 1)];
+        int result = -1;
+
+        if (sqe->opcode == IO_OP_NOP) {
+            result = 0;
+        } else if (sqe->filename && sqe->buffer) {
+            if (!cached_name || strcmp(cached_name, sqe->filename) != 0) {
+                cached_name = sqe->filename;
+                cached_file = file_lookup(sqe->filename);
+            }
+            if (sqe->opcode == IO_OP_READ && cached_file) {
+                result = file_read_at(cached_file, sqe->offset,
+                                      (uint8_t*)sqe->buffer, sqe->length);
+            } else if (sqe->opcode == IO_OP_WRITE) {
+                if (!cached_file) {
+                    // Creates the file; look it up again next time
+                    result = write_file_range(sqe->filename, sqe->offset,
+                                              (const uint8_t*)sqe->buffer, sqe->length);
+                    cached_name = nullptr;
+                } else {
+                    result = file_write_at(cached_file, sqe->offset,
+                                           (const uint8_t*)sqe->buffer, sqe->length);
+                }
+            }
+        }
+
+        struct io_cqe* cqe = &ring->cq[cq_tail & (ring->cq_entries - 1)];
+        cqe->user_data = sqe->user_data;
+        cqe->result = result;
+        cq_tail++;
+        head++;
+    }
+
+    // Publish the whole batch at once
+    store_release(&ring->cq_tail, cq_tail);
+    store_release(&ring->sq_head, head);
+}
+
+extern "C" void aio_poll() {
+    for (struct io_ring* ring = rings; ring; ring = ring->next) {
+        if (ring->sq_head != load_acquire(&ring->sq_tail)) {
+            service_ring(ring);
+        }
+    }
+}
+
+// Only rings the driver can make progress on count; one whose completion
+// ring is full waits for its caller, so it must not keep the CPU awake
+extern "C" bool aio_pending() {
+    for (struct io_ring* ring = rings; ring; ring = ring->next) {
+        if (ring->sq_head != load_acquire(&ring->sq_tail) &&
+            ring->cq_tail - load_acquire(&ring->cq_head) < ring->cq_entries) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,79 @@
+#ifndef AIO_H
+#define AIO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Request opcodes
+#define IO_OP_NOP   0
+#define IO_OP_READ  1
+#define IO_OP_WRITE 2
+
+// Requests serviced per ring on each driver pass
+#define AIO_BATCH 32
+
+// Submission queue entry, filled in by the caller
+struct io_sqe {
+    uint8_t opcode;
+    const char* filename;
+    void* buffer;
+    size_t offset;
+    size_t length;
+    uint64_t user_data;
+};
+
+// Completion queue entry: bytes transferred, or -1 on failure
+struct io_cqe {
+    uint64_t user_data;
+    int32_t result;
+};
+
+// A pair of single-producer/single-consumer rings. The caller produces
+// submissions and consumes completions; the driver does the reverse.
+struct io_ring {
+    struct io_sqe* sq;
+    struct io_cqe* cq;
+    uint32_t sq_entries;
+    uint32_t cq_entries;
+    uint32_t sq_prepared;   // Caller-private tail of filled-in entries
+    uint32_t sq_head;       // Advanced by the driver
+    uint32_t sq_tail;       // Published by io_submit()
+    uint32_t cq_head;       // Advanced by the caller
+    uint32_t cq_tail;       // Published by the driver
+    struct io_ring* next;   // Driver's list of rings
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// entries must be a power of two; the completion ring gets twice as many
+int io_ring_init(struct io_ring* ring, uint32_t entries);
+void io_ring_destroy(struct io_ring* ring);
+
+// Next free submission slot, or nullptr if the ring is full
+struct io_sqe* io_get_sqe(struct io_ring* ring);
+
+// Hand all prepared entries to the driver; returns how many
+int io_submit(struct io_ring* ring);
+
+// Oldest unconsumed completion, or nullptr; release it with io_cqe_seen()
+struct io_cqe* io_peek_cqe(struct io_ring* ring);
+void io_cqe_seen(struct io_ring* ring);
+
+// Run the driver until a completion is available
+struct io_cqe* io_wait_cqe(struct io_ring* ring);
+
+// Driver entry point, called from the kernel's main loop
+void aio_poll(void);
+
+// Whether aio_poll() has work it can do now; a ring waiting for its
+// completions to be consumed does not count
+bool aio_pending(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AIO_H
@@ -0,0 +1,410 @@
+#include "apic.h"
+#include "clock.h"
+#include "interrupts.h"
+#include "kernel.h"
+#include "klog.h"
+#include "paging.h"
+#include "memory.h"
+#include "io.h"
+
+// MMIO window for the APIC register pages
+#define APIC_VIRT_BASE   0xFF000000
+#define LAPIC_VIRT       APIC_VIRT_BASE
+#define IOAPIC_VIRT      (APIC_VIRT_BASE + PAGE_SIZE)
+
+#define IA32_APIC_BASE_MSR    0x1B
+#define APIC_BASE_ENABLE      (1u << 11)
+#define APIC_BASE_ADDR_MASK   0xFFFFF000u
+#define CPUID_FEATURES        0x00000001
+#define CPUID_FEATURE_APIC    (1u << 9)
+
+// Local APIC registers
+#define LAPIC_ID              0x020
+#define LAPIC_TPR             0x080
+#define LAPIC_EOI             0x0B0
+#define LAPIC_SVR             0x0F0
+#define LAPIC_IRR             0x200   // Eight registers, 0x10 apart
+#define LAPIC_LVT_TIMER       0x320
+#define LAPIC_LVT_LINT0       0x350
+#define LAPIC_LVT_ERROR       0x370
+#define LAPIC_TIMER_INITIAL   0x380
+#define LAPIC_TIMER_CURRENT   0x390
+#define LAPIC_TIMER_DIVIDE    0x3E0
+
+#define LAPIC_SVR_ENABLE      0x100
+#define LAPIC_LVT_MASKED      0x10000
+#define LAPIC_TIMER_PERIODIC  0x20000
+#define LAPIC_DIVIDE_BY_16    0x3
+#define LAPIC_CALIBRATE_MS    10
+
+// I/O APIC registers
+#define IOAPIC_REGSEL         0x00
+#define IOAPIC_WINDOW         0x10
+#define IOAPIC_VERSION        0x01
+#define IOAPIC_REDIRECTION    0x10    // Two registers per pin
+
+#define IOAPIC_ACTIVE_LOW     (1u << 13)
+#define IOAPIC_LEVEL          (1u << 15)
+#define IOAPIC_MASKED         (1u << 16)
+
+#define ISA_IRQS              16
+#define ISA_UNROUTED          0xFF
+#define IOAPIC_DEFAULT_BASE   0xFEC00000
+
+// MP specification structures
+#define MP_FLOATING_SIGNATURE 0x5F504D5F  // "_MP_"
+#define MP_CONFIG_SIGNATURE   0x504D4350  // "PCMP"
+#define MP_ENTRY_PROCESSOR    0
+#define MP_ENTRY_BUS          1
+#define MP_ENTRY_IOAPIC       2
+#define MP_ENTRY_IO_INTERRUPT 3
+#define MP_IOAPIC_USABLE      0x01
+#define MP_INT_VECTORED       0
+#define MP_POLARITY_LOW       0x3
+#define MP_TRIGGER_LEVEL      0xC
+#define MP_MAX_BUSES          32
+
+// BIOS data area
+#define BDA_EBDA_SEGMENT      0x40E
+#define BDA_BASE_MEMORY_KB    0x413
+
+struct mp_floating {
+    uint32_t signature;
+    uint32_t config;        // Physical address of the configuration table
+    uint8_t length;         // In 16-byte units
+    uint8_t revision;
+    uint8_t checksum;
+    uint8_t features[5];    // features[0] != 0 selects a default configuration
+} __attribute__((packed));
+
+struct mp_config {
+    uint32_t signature;
+    uint16_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem[8];
+    char product[12];
+    uint32_t oem_table;
+    uint16_t oem_table_size;
+    uint16_t entry_count;
+    uint32_t lapic_address;
+    uint16_t extended_length;
+    uint8_t extended_checksum;
+    uint8_t reserved;
+} __attribute__((packed));
+
+struct mp_ioapic {
+    uint8_t type;
+    uint8_t id;
+    uint8_t version;
+    uint8_t flags;
+    uint32_t address;
+} __attribute__((packed));
+
+struct mp_io_interrupt {
+    uint8_t type;
+    uint8_t interrupt_type;
+    uint16_t flags;         // Polarity in bits 0-1, trigger mode in bits 2-3
+    uint8_t bus;
+    uint8_t bus_irq;
+    uint8_t ioapic_id;
+    uint8_t pin;
+} __attribute__((packed));
+
+// How an ISA IRQ reaches the I/O APIC
+struct isa_route {
+    uint8_t pin;            // ISA_UNROUTED if the IRQ has no pin
+    uint32_t flags;         // IOAPIC_ACTIVE_LOW and IOAPIC_LEVEL
+};
+
+static volatile uint32_t* lapic = nullptr;
+static volatile uint32_t* ioapic = nullptr;
+static uintptr_t ioapic_phys = 0;
+static unsigned ioapic_pins = 0;
+static uint8_t bsp_apic_id = 0;
+static uint8_t timer_vector = 0;
+static uint32_t timer_period = 0;   // Timer counts per tick
+static struct isa_route isa_routes[ISA_IRQS];
+
+static inline uint32_t lapic_read(uint32_t reg) {
+    return lapic[reg / 4];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value) {
+    lapic[reg / 4] = value;
+}
+
+static uint32_t ioapic_read(uint32_t reg) {
+    ioapic[IOAPIC_REGSEL / 4] = reg;
+    return ioapic[IOAPIC_WINDOW / 4];
+}
+
+static void ioapic_write(uint32_t reg, uint32_t value) {
+    ioapic[IOAPIC_REGSEL / 4] = reg;
+    ioapic[IOAPIC_WINDOW / 4] = value;
+}
+
+// BIOS data area fields sit near address 0, which the compiler would
+// otherwise take for a null dereference
+static inline uint16_t bda_read16(uintptr_t address) {
+    asm("" : "+r"(address));
+    return *(const volatile uint16_t*)address;
+}
+
+static bool checksum_ok(const void* data, size_t length) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint8_t sum = 0;
+    for (size_t i = 0; i < length; i++) {
+        sum += bytes[i];
+    }
+    return sum == 0;
+}
+
+static const struct mp_floating* mp_scan(uintptr_t start, size_t length) {
+    for (uintptr_t p = start; p + sizeof(struct mp_floating) <= start + length; p += 16) {
+        const struct mp_floating* mp = (const struct mp_floating*)p;
+        if (mp->signature == MP_FLOATING_SIGNATURE && mp->length == 1 &&
+            checksum_ok(mp, sizeof(*mp))) {
+            return mp;
+        }
+    }
+    return nullptr;
+}
+
+// The floating pointer lives in the first KiB of the EBDA, the last KiB
+// of base memory or the BIOS ROM
+static const struct mp_floating* mp_find() {
+    uintptr_t ebda = (uintptr_t)bda_read16(BDA_EBDA_SEGMENT) << 4;
+    uintptr_t base_top = (uintptr_t)bda_read16(BDA_BASE_MEMORY_KB) * 1024;
+    const struct mp_floating* mp = nullptr;
+
+    if (ebda) {
+        mp = mp_scan(ebda, 1024);
+    }
+    if (!mp && base_top >= 1024) {
+        mp = mp_scan(base_top - 1024, 1024);
+    }
+    if (!mp) {
+        mp = mp_scan(0xF0000, 0x10000);
+    }
+    return mp;
+}
+
+// IRQs the table doesn't list are identity-mapped, unless a listed IRQ
+// took their pin (the timer usually takes IRQ2's, the PIC cascade)
+static void drop_shadowed_routes(uint16_t listed) {
+    for (unsigned irq = 0; irq < ISA_IRQS; irq++) {
+        if (listed & (1u << irq)) {
+            continue;
+        }
+        for (unsigned other = 0; other < ISA_IRQS; other++) {
+            if ((listed & (1u << other)) && isa_routes[other].pin == isa_routes[irq].pin) {
+                isa_routes[irq].pin = ISA_UNROUTED;
+                break;
+            }
+        }
+    }
+}
+
+// Fill in the I/O APIC address and ISA routes. Only the first usable
+// I/O APIC is used, which carries the ISA IRQs on every MP system.
+static bool mp_parse() {
+    for (unsigned irq = 0; irq < ISA_IRQS; irq++) {
+        isa_routes[irq].pin = irq;
+        isa_routes[irq].flags = 0;
+    }
+
+    const struct mp_floating* mp = mp_find();
+    if (!mp) {
+        return false;
+    }
+    if (mp->features[0] || !mp->config) {
+        // Default configuration: one I/O APIC with the timer on pin 2
+        ioapic_phys = IOAPIC_DEFAULT_BASE;
+        isa_routes[0].pin = 2;
+        drop_shadowed_routes(1u << 0);
+        return true;
+    }
+
+    // Only tables in the identity-mapped region can be read as is
+    const struct mp_config* config = (const struct mp_config*)mp->config;
+    if (mp->config >= PAGING_IDENTITY_LIMIT - sizeof(*config) ||
+        config->signature != MP_CONFIG_SIGNATURE ||
+        mp->config + config->length > PAGING_IDENTITY_LIMIT ||
+        !checksum_ok(config, config->length)) {
+        return false;
+    }
+
+    bool isa_bus[MP_MAX_BUSES] = {};
+    int ioapic_id = -1;
+    uint16_t listed = 0;
+    const uint8_t* entry = (const uint8_t*)(config + 1);
+    const uint8_t* end = (const uint8_t*)config + config->length;
+
+    for (unsigned i = 0; i < config->entry_count && entry < end; i++) {
+        switch (entry[0]) {
+            case MP_ENTRY_PROCESSOR:
+                entry += 20;
+                break;
+            case MP_ENTRY_BUS:
+                if (entry[1] < MP_MAX_BUSES) {
+                    isa_bus[entry[1]] = entry[2] == 'I' && entry[3] == 'S' && entry[4] == 'A';
+                }
+                entry += 8;
+                break;
+            case MP_ENTRY_IOAPIC: {
+                const struct mp_ioapic* io = (const struct mp_ioapic*)entry;
+                if (ioapic_id < 0 && (io->flags & MP_IOAPIC_USABLE)) {
+                    ioapic_id = io->id;
+                    ioapic_phys = io->address;
+                }
+                entry += 8;
+                break;
+            }
+            case MP_ENTRY_IO_INTERRUPT: {
+                // Bus entries come first, so the bus type is known here
+                const struct mp_io_interrupt* in = (const struct mp_io_interrupt*)entry;
+                if (in->interrupt_type == MP_INT_VECTORED && in->bus < MP_MAX_BUSES &&
+                    isa_bus[in->bus] && in->bus_irq < ISA_IRQS &&
+                    (ioapic_id < 0 || in->ioapic_id == ioapic_id)) {
+                    struct isa_route* route = &isa_routes[in->bus_irq];
+                    listed |= 1u << in->bus_irq;
+                    route->pin = in->pin;
+                    route->flags = 0;
+                    if ((in->flags & MP_POLARITY_LOW) == MP_POLARITY_LOW) {
+                        route->flags |= IOAPIC_ACTIVE_LOW;
+                    }
+                    if ((in->flags & MP_TRIGGER_LEVEL) == MP_TRIGGER_LEVEL) {
+                        route->flags |= IOAPIC_LEVEL;
+                    }
+                }
+                entry += 8;
+                break;
+            }
+            default:
+                entry += 8;
+                break;
+        }
+    }
+    drop_shadowed_routes(listed);
+    return ioapic_id >= 0;
+}
+
+static void ioapic_route(unsigned irq, bool masked) {
+    const struct isa_route* route = &isa_routes[irq];
+    if (route->pin >= ioapic_pins) {
+        return;
+    }
+    uint32_t low = (IRQ0 + irq) | route->flags | (masked ? IOAPIC_MASKED : 0);
+    ioapic_write(IOAPIC_REDIRECTION + route->pin * 2 + 1, (uint32_t)bsp_apic_id << 24);
+    ioapic_write(IOAPIC_REDIRECTION + route->pin * 2, low);
+}
+
+bool apic_init() {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(CPUID_FEATURES, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_FEATURE_APIC) || !mp_parse()) {
+        return false;
+    }
+
+    uint64_t base = rdmsr(IA32_APIC_BASE_MSR);
+    uintptr_t lapic_phys = (uintptr_t)base & APIC_BASE_ADDR_MASK;
+    if (paging_map_page(LAPIC_VIRT, lapic_phys, PAGE_WRITABLE | PAGE_CACHE_DISABLE) < 0 ||
+        paging_map_page(IOAPIC_VIRT, ioapic_phys & APIC_BASE_ADDR_MASK, PAGE_WRITABLE | PAGE_CACHE_DISABLE) < 0) {
+        return false;
+    }
+    wrmsr(IA32_APIC_BASE_MSR, base | APIC_BASE_ENABLE);
+
+    lapic = (volatile uint32_t*)LAPIC_VIRT;
+    ioapic = (volatile uint32_t*)(IOAPIC_VIRT + (ioapic_phys & ~APIC_BASE_ADDR_MASK));
+    ioapic_pins = ((ioapic_read(IOAPIC_VERSION) >> 16) & 0xFF) + 1;
+    bsp_apic_id = lapic_read(LAPIC_ID) >> 24;
+
+    // Accept every priority; the PIC's virtual-wire input is no longer used
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_LVT_ERROR, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+
+    for (unsigned pin = 0; pin < ioapic_pins; pin++) {
+        ioapic_write(IOAPIC_REDIRECTION + pin * 2, IOAPIC_MASKED);
+    }
+    for (unsigned irq = 0; irq < ISA_IRQS; irq++) {
+        ioapic_route(irq, false);
+    }
+
+    klog(KLOG_INFO, "apic: local APIC %u, I/O APIC at 0x%x with %u pins",
+         (unsigned)bsp_apic_id, (unsigned)ioapic_phys, ioapic_pins);
+    return true;
+}
+
+bool apic_enabled() {
+    return lapic != nullptr;
+}
+
+void lapic_eoi() {
+    lapic_write(LAPIC_EOI, 0);
+}
+
+void ioapic_set_masked(unsigned irq, bool masked) {
+    if (ioapic && irq < ISA_IRQS) {
+        ioapic_route(irq, masked);
+    }
+}
+
+bool lapic_timer_start(uint32_t hz, uint8_t vector) {
+    uint32_t tsc_khz = clock_tsc_khz();
+    if (!lapic || !tsc_khz) {
+        return false;
+    }
+
+    // Count down from the top for a TSC-timed interval
+    lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_DIVIDE_BY_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+    uint64_t start = rdtsc();
+    lapic_write(LAPIC_TIMER_INITIAL, 0xFFFFFFFF);
+    while (rdtsc() - start < (uint64_t)tsc_khz * LAPIC_CALIBRATE_MS) {
+    }
+    uint32_t elapsed = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CURRENT);
+    lapic_write(LAPIC_TIMER_INITIAL, 0);
+
+    uint32_t per_second = elapsed * (1000 / LAPIC_CALIBRATE_MS);
+    uint32_t count = per_second / hz;
+    if (count == 0) {
+        return false;
+    }
+
+    timer_vector = vector;
+    timer_period = count;
+    lapic_timer_periodic(count);
+    klog(KLOG_INFO, "apic: timer at %u Hz from a %u kHz count", hz, per_second / 1000);
+    return true;
+}
+
+uint32_t lapic_timer_period() {
+    return timer_period;
+}
+
+void lapic_timer_periodic(uint32_t count) {
+    lapic_write(LAPIC_LVT_TIMER, timer_vector | LAPIC_TIMER_PERIODIC);
+    lapic_write(LAPIC_TIMER_INITIAL, count);
+}
+
+void lapic_timer_oneshot(uint32_t count) {
+    lapic_write(LAPIC_LVT_TIMER, timer_vector);
+    lapic_write(LAPIC_TIMER_INITIAL, count);
+}
+
+void lapic_timer_mask() {
+    lapic_write(LAPIC_LVT_TIMER, lapic_read(LAPIC_LVT_TIMER) | LAPIC_LVT_MASKED);
+}
+
+uint32_t lapic_timer_remaining() {
+    return lapic_read(LAPIC_TIMER_CURRENT);
+}
+
+bool lapic_timer_pending() {
+    uint32_t irr = lapic_read(LAPIC_IRR + (timer_vector / 32) * 0x10);
+    return (irr >> (timer_vector % 32)) & 1;
+}
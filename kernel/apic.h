@@ -0,0 +1,52 @@
+#ifndef APIC_H
+#define APIC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Vectors owned by the local APIC. The I/O APIC delivers ISA IRQ n on
+// IRQ0 + n, as the remapped PIC did.
+#define APIC_TIMER_VECTOR    0x40
+#define APIC_SPURIOUS_VECTOR 0xFF
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Enable the local APIC and route the ISA IRQs through the I/O APIC
+// described by the MP table. Returns false, leaving the hardware alone,
+// if either is missing; the caller then keeps the 8259 PIC.
+bool apic_init(void);
+bool apic_enabled(void);
+
+// Signal end of interrupt to the local APIC
+void lapic_eoi(void);
+
+// Mask or unmask an ISA IRQ at the I/O APIC
+void ioapic_set_masked(unsigned irq, bool masked);
+
+// Run the local APIC timer periodically at hz on vector. Returns false
+// if there is no local APIC or its rate could not be measured.
+bool lapic_timer_start(uint32_t hz, uint8_t vector);
+
+// Timer counts per tick once started
+uint32_t lapic_timer_period(void);
+
+// Reprogram the started timer: periodic every count, or a single
+// interrupt after count. Writing a count restarts the countdown.
+void lapic_timer_periodic(uint32_t count);
+void lapic_timer_oneshot(uint32_t count);
+uint32_t lapic_timer_remaining(void);
+
+// Stop the timer raising interrupts until it is next programmed; the
+// count keeps running
+void lapic_timer_mask(void);
+
+// Whether a timer interrupt is waiting to be delivered
+bool lapic_timer_pending(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // APIC_H
@@ -0,0 +1,132 @@
+#include "clock.h"
+#include "kernel.h"
+#include "klog.h"
+#include "timer.h"
+#include "io.h"
+
+// PIT channel 2 is gated through the keyboard controller's port B and
+// its output can be read back there, so it can time an interval without
+// interrupts
+#define PIT_CHANNEL2      0x42
+#define PIT_COMMAND       0x43
+#define PIT_FREQUENCY     1193182
+#define PIT_MODE_ONESHOT2 0xB0  // Channel 2, lobyte/hibyte, interrupt on terminal count
+#define PORT_B            0x61
+#define PORT_B_GATE2      0x01
+#define PORT_B_SPEAKER    0x02
+#define PORT_B_OUT2       0x20
+
+// Calibration window and attempts; the shortest measurement wins, since
+// anything that stalls the CPU only makes a window look longer
+#define CALIBRATE_PIT_COUNT 11932   // 10 ms
+#define CALIBRATE_ROUNDS    3
+
+#define CPUID_FEATURES          0x00000001
+#define CPUID_FEATURE_TSC       (1u << 4)
+#define CPUID_EXTENDED_MAX      0x80000000
+#define CPUID_POWER_MANAGEMENT  0x80000007
+#define CPUID_INVARIANT_TSC     (1u << 8)
+
+// ns = (cycles * mult) >> shift, with the shift as large as mult allows
+static uint64_t tsc_base = 0;
+static uint32_t tsc_mult = 0;
+static uint32_t tsc_shift = 0;
+static uint32_t tsc_khz = 0;
+static bool tsc_invariant = false;
+
+extern "C" uint64_t clock_div_u64(uint64_t n, uint32_t d, uint32_t* remainder) {
+    uint32_t hi = (uint32_t)(n >> 32);
+    uint32_t q_hi = hi / d;
+    uint32_t r = hi % d;
+    uint32_t q_lo;
+    // r < d, so the quotient fits in 32 bits
+    asm("divl %4" : "=a"(q_lo), "=d"(r) : "a"((uint32_t)n), "d"(r), "rm"(d));
+    if (remainder) {
+        *remainder = r;
+    }
+    return ((uint64_t)q_hi << 32) | q_lo;
+}
+
+// TSC cycles while PIT channel 2 counts down one window
+static uint64_t calibrate_window() {
+    uint8_t port_b = inb(PORT_B);
+    outb(PORT_B, (port_b & ~PORT_B_SPEAKER) & ~PORT_B_GATE2);
+
+    outb(PIT_COMMAND, PIT_MODE_ONESHOT2);
+    outb(PIT_CHANNEL2, CALIBRATE_PIT_COUNT & 0xFF);
+    outb(PIT_CHANNEL2, CALIBRATE_PIT_COUNT >> 8);
+
+    // Raising the gate starts the count; OUT2 goes high at zero
+    outb(PORT_B, (port_b & ~PORT_B_SPEAKER) | PORT_B_GATE2);
+    uint64_t start = rdtsc();
+    while (!(inb(PORT_B) & PORT_B_OUT2)) {
+    }
+    uint64_t end = rdtsc();
+
+    outb(PORT_B, port_b);
+    return end - start;
+}
+
+void clock_init() {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(CPUID_FEATURES, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_FEATURE_TSC)) {
+        klog(KLOG_WARN, "clock: no TSC, using the %u Hz tick", (unsigned)TIMER_HZ);
+        return;
+    }
+    cpuid(CPUID_EXTENDED_MAX, &eax, &ebx, &ecx, &edx);
+    if (eax >= CPUID_POWER_MANAGEMENT) {
+        cpuid(CPUID_POWER_MANAGEMENT, &eax, &ebx, &ecx, &edx);
+        tsc_invariant = (edx & CPUID_INVARIANT_TSC) != 0;
+    }
+
+    uint64_t cycles = ~0ull;
+    for (int i = 0; i < CALIBRATE_ROUNDS; i++) {
+        uint64_t window = calibrate_window();
+        if (window < cycles) {
+            cycles = window;
+        }
+    }
+
+    // kHz = cycles * PIT_FREQUENCY / (count * 1000), fine up to 4 THz
+    uint64_t khz = clock_div_u64(cycles * PIT_FREQUENCY, CALIBRATE_PIT_COUNT * 1000, nullptr);
+    if (khz == 0 || khz > 0xFFFFFFFF) {
+        klog(KLOG_WARN, "clock: TSC calibration failed, using the %u Hz tick", (unsigned)TIMER_HZ);
+        return;
+    }
+    tsc_khz = (uint32_t)khz;
+
+    // mult = 10^6 << shift / kHz, largest shift that keeps it in 32 bits
+    tsc_shift = 32;
+    uint64_t mult;
+    while ((mult = clock_div_u64(1000000ull << tsc_shift, tsc_khz, nullptr)) > 0xFFFFFFFF) {
+        tsc_shift--;
+    }
+    tsc_mult = (uint32_t)mult;
+    tsc_base = rdtsc();
+
+    klog(KLOG_INFO, "clock: TSC at %u kHz%s", tsc_khz,
+         tsc_invariant ? ", invariant" : ", not invariant; timestamps may drift");
+}
+
+extern "C" uint64_t clock_ns() {
+    if (!tsc_mult) {
+        // No usable TSC: tick resolution
+        return (uint64_t)kernel_get_ticks() * (1000000000u / TIMER_HZ);
+    }
+
+    // 64 x 32 bit multiply in two halves; the high half is small for
+    // any realistic uptime, so the shifted sum fits in 64 bits
+    uint64_t cycles = rdtsc() - tsc_base;
+    uint64_t lo = (uint64_t)(uint32_t)cycles * tsc_mult;
+    uint64_t hi = (uint64_t)(uint32_t)(cycles >> 32) * tsc_mult;
+    return (hi << (32 - tsc_shift)) + (lo >> tsc_shift);
+}
+
+extern "C" uint32_t clock_tsc_khz() {
+    return tsc_khz;
+}
+
+extern "C" bool clock_tsc_invariant() {
+    return tsc_invariant;
+}
@@ -0,0 +1,32 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Calibrate the TSC against PIT channel 2. Called once at boot, before
+// anything relies on clock_ns().
+void clock_init(void);
+
+// Monotonic nanoseconds since clock_init(). Reads the TSC and scales it
+// with one multiply, so it is cheap enough for per-event timestamps.
+uint64_t clock_ns(void);
+
+// TSC rate measured at boot, and whether the CPU reports it constant
+// across frequency and power state changes
+uint32_t clock_tsc_khz(void);
+bool clock_tsc_invariant(void);
+
+// n / d and n % d with 32-bit divides only; the kernel does not link
+// the libgcc 64-bit helpers
+uint64_t clock_div_u64(uint64_t n, uint32_t d, uint32_t* remainder);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CLOCK_H
@@ -0,0 +1,47 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Largest screen the terminal can drive, in character cells
+#define TERMINAL_MAX_COLS 160
+#define TERMINAL_MAX_ROWS 64
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct multiboot_info;
+
+// A display the terminal renders to. Cells are VGA text entries: the
+// character in the low byte and the colour attribute in the high byte.
+struct console_driver {
+    size_t cols;
+    size_t rows;
+
+    // Draw one screen row from cols cells
+    void (*draw_row)(size_t row, const uint16_t* cells);
+
+    // Move the screen contents up by lines, or down if negative. Returns
+    // false if they were not kept and every row has to be drawn again.
+    bool (*scroll)(int lines);
+
+    // Show the cursor at a cell, or hide it
+    void (*set_cursor)(size_t row, size_t col, bool visible);
+};
+
+// Switch the terminal to another display; the screen is cleared
+void terminal_set_driver(const struct console_driver* driver);
+
+// Framebuffer console on the graphics mode the bootloader set up: RGB at
+// 15, 16, 24 or 32 bpp, or 8 bpp indexed. Returns nullptr in text mode,
+// and also, after logging why, for a graphics mode it can't drive.
+const struct console_driver* fbcon_init(const struct multiboot_info* info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CONSOLE_H
@@ -0,0 +1,93 @@
+#include "crc32c.h"
+#include "io.h"
+
+#define CRC32C_POLY      0x82F63B78  // Castagnoli, bit-reflected
+#define CPUID_ECX_SSE4_2 (1u << 20)
+
+static uint32_t crc_tables[8][256];
+static bool use_hardware = false;
+static bool initialized = false;
+
+static inline uint32_t load32(const uint8_t* p) {
+    uint32_t v;
+    __builtin_memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static void build_tables() {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int bit = 0; bit < 8; bit++) {
+            c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        }
+        crc_tables[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            uint32_t prev = crc_tables[t - 1][i];
+            crc_tables[t][i] = (prev >> 8) ^ crc_tables[0][prev & 0xFF];
+        }
+    }
+}
+
+void crc32c_init() {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    use_hardware = (ecx & CPUID_ECX_SSE4_2) != 0;
+    if (!use_hardware) {
+        build_tables();
+    }
+    initialized = true;
+}
+
+bool crc32c_hw_available() {
+    return use_hardware;
+}
+
+// Four bytes per crc32 instruction, then the tail a byte at a time
+static uint32_t crc32c_hardware(uint32_t crc, const uint8_t* p, size_t length) {
+    while (length >= 4) {
+        asm("crc32l %1, %0" : "+r"(crc) : "rm"(load32(p)));
+        p += 4;
+        length -= 4;
+    }
+    while (length--) {
+        asm("crc32b %1, %0" : "+r"(crc) : "rm"(*p++));
+    }
+    return crc;
+}
+
+// Slicing-by-8: eight table lookups consume eight bytes per step
+static uint32_t crc32c_software(uint32_t crc, const uint8_t* p, size_t length) {
+    while (length >= 8) {
+        uint32_t lo = load32(p) ^ crc;
+        uint32_t hi = load32(p + 4);
+        crc = crc_tables[7][lo & 0xFF] ^
+              crc_tables[6][(lo >> 8) & 0xFF] ^
+              crc_tables[5][(lo >> 16) & 0xFF] ^
+              crc_tables[4][lo >> 24] ^
+              crc_tables[3][hi & 0xFF] ^
+              crc_tables[2][(hi >> 8) & 0xFF] ^
+              crc_tables[1][(hi >> 16) & 0xFF] ^
+              crc_tables[0][hi >> 24];
+        p += 8;
+        length -= 8;
+    }
+    while (length--) {
+        crc = (crc >> 8) ^ crc_tables[0][(crc ^ *p++) & 0xFF];
+    }
+    return crc;
+}
+
+uint32_t crc32c_update(uint32_t crc, const void* data, size_t length) {
+    if (!initialized) {
+        crc32c_init();
+    }
+    const uint8_t* p = (const uint8_t*)data;
+    return use_hardware ? crc32c_hardware(crc, p, length)
+                        : crc32c_software(crc, p, length);
+}
+
+uint32_t crc32c(const void* data, size_t length) {
+    return ~crc32c_update(0xFFFFFFFF, data, length);
+}
@@ -0,0 +1,27 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Pick the SSE4.2 crc32 instruction when CPUID reports it, otherwise
+// build the slicing-by-8 tables
+void crc32c_init(void);
+bool crc32c_hw_available(void);
+
+// Continue a CRC32C over more data; the state is not inverted
+uint32_t crc32c_update(uint32_t crc, const void* data, size_t length);
+
+// CRC32C (Castagnoli) of a buffer
+uint32_t crc32c(const void* data, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CRC32C_H
@@ -4,8 +4,21 @@
 #include "kernel.h"
 #include "string.h"
 #include "compiler.h"
+#include "mmap.h"
+#include "serial.h"
+#include "klog.h"
+#include "interrupts.h"
+#include "timer.h"
 #include <stddef.h>
 
+// Typed characters gathered before one buffer update
+#define EDITOR_INSERT_RUN 256
+
+// Minimum timer ticks between redraws; 0 draws after every batch
+#ifndef EDITOR_FRAME_TICKS
+#define EDITOR_FRAME_TICKS 0
+#endif
+
 // Editor state
 static struct {
     char* buffer;
@@ -16,6 +29,7 @@ static struct {
     size_t screen_rows;
     size_t screen_cols;
     bool is_modified;
+    bool is_mapped;     // buffer points at a read-only file mapping
 } E;
 
 void editor_init() {
@@ -32,45 +46,74 @@ void editor_init() {
     if (E.screen_cols == 0) E.screen_cols = 80;
     E.screen_rows--; // Make room for status line
     E.is_modified = false;
+    E.is_mapped = false;
     compiler_init();
 }
 
+// Drop a buffer that has been replaced by an edited copy
+static void editor_release_buffer(char* buffer) {
+    if (E.is_mapped) {
+        file_munmap(buffer);
+        E.is_mapped = false;
+    } else {
+        free(buffer);
+    }
+}
+
 void editor_open(const char* filename) {
     E.filename = filename;
-    char* data = read_file(filename);
+
+    // Map the file instead of copying it; the first edit makes a
+    // private copy
+    size_t size = file_get_size(filename);
+    const void* data = size ? file_mmap(filename, 0, size) : nullptr;
     if (data != nullptr) {
-        E.buffer = data;
-        E.buffer_size = strlen(data);
+        E.buffer = (char*)data;
+        E.buffer_size = size;
+        E.is_mapped = true;
     }
 }
 
-void editor_insert_char(char c) {
-    // Reallocate buffer if needed
-    size_t new_size = E.buffer_size + 2;  // +1 for new char, +1 for null terminator
+void editor_insert_text(const char* text, size_t length) {
+    if (length == 0) return;
+
+    // Reallocate buffer once for the whole run
+    size_t new_size = E.buffer_size + length + 1;  // +1 for null terminator
     char* new_buffer = (char*)malloc(new_size);
     
     if (new_buffer) {
         // Copy existing content
         if (E.buffer) {
             memcpy(new_buffer, E.buffer, E.buffer_size);
-            free(E.buffer);
+            editor_release_buffer(E.buffer);
         }
         
-        // Insert new character and null terminator
-        new_buffer[E.buffer_size] = c;
-        new_buffer[E.buffer_size + 1] = '\0';
+        // Append the text and null terminator
+        memcpy(new_buffer + E.buffer_size, text, length);
+        new_buffer[new_size - 1] = '\0';
         
         E.buffer = new_buffer;
         E.buffer_size = new_size - 1;  // Don't count null terminator in size
-        E.cursor_x++;
-        
-        if (E.cursor_x >= E.screen_cols) {
-            E.cursor_x = 0;
-            E.cursor_y++;
+
+        for (size_t i = 0; i < length; i++) {
+            if (text[i] == '\n') {
+                E.cursor_x = 0;
+                E.cursor_y++;
+                continue;
+            }
+            E.cursor_x++;
+            if (E.cursor_x >= E.screen_cols) {
+                E.cursor_x = 0;
+                E.cursor_y++;
+            }
         }
     }
 }
 
+void editor_insert_char(char c) {
+    editor_insert_text(&c, 1);
+}
+
 void editor_delete_char() {
     if (E.buffer_size > 0 && E.cursor_x > 0) {
         // Create new buffer with one less character
@@ -88,7 +131,7 @@ void editor_delete_char() {
                        E.buffer_size - E.cursor_x);
             }
             
-            free(E.buffer);
+            editor_release_buffer(E.buffer);
             E.buffer = new_buffer;
             E.buffer_size = new_size - 1;
             E.cursor_x--;
@@ -96,15 +139,31 @@ void editor_delete_char() {
     }
 }
 
+// Write one row of file text. Control bytes other than tab are shown as
+// '?' so file contents can't drive the terminal's escape sequences.
+static void editor_draw_text(const char* text, size_t length) {
+    size_t start = 0;
+    for (size_t i = 0; i < length; i++) {
+        uint8_t c = (uint8_t)text[i];
+        if ((c < 32 && c != '\t') || c == 0x7F) {
+            terminal_write(text + start, i - start);
+            terminal_write_char('?');
+            start = i + 1;
+        }
+    }
+    terminal_write(text + start, length - start);
+}
+
 void editor_refresh_screen() {
-    terminal_clear();
+    // Redraw in place with escape sequences: each row is rewritten and
+    // erased to its end, so only cells that change reach the display
+    terminal_begin_update();
+    terminal_write_string("\x1b[?25l\x1b[H");
     
-    // Display buffer content
-    if (E.buffer) {
-        size_t pos = 0;
-        size_t row = 0;
-        
-        while (pos < E.buffer_size && row < E.screen_rows) {
+    size_t pos = 0;
+    for (size_t row = 0; row < E.screen_rows; row++) {
+        size_t width = 0;   // Columns written on this row
+        if (E.buffer && pos < E.buffer_size) {
             // Find end of current line
             size_t line_end = pos;
             while (line_end < E.buffer_size && E.buffer[line_end] != '\n') {
@@ -118,20 +177,17 @@ void editor_refresh_screen() {
             }
             
             // Write line to screen
-            terminal_write(E.buffer + pos, line_length);
-            terminal_write_string("\r\n");
-            
+            editor_draw_text(E.buffer + pos, line_length);
+            width = line_length;
             pos = line_end + 1;
-            row++;
-        }
-    } else {
-        // Display welcome message
-        if (E.screen_rows > 2) {
+        } else if (!E.buffer && row == 0 && E.screen_rows > 2) {
+            // Display welcome message
             char welcome[] = "Editor -- version 2.0.0";
             size_t welcomelen = strlen(welcome);
             if (welcomelen > E.screen_cols) welcomelen = E.screen_cols;
             
             size_t padding = (E.screen_cols - welcomelen) / 2;
+            width = padding + welcomelen;
             if (padding) {
                 terminal_write_char('~');
                 padding--;
@@ -139,24 +195,29 @@ void editor_refresh_screen() {
             while (padding--) terminal_write_char(' ');
             terminal_write_string(welcome);
         }
+        // A full row leaves the cursor on a pending wrap, where erasing
+        // would blank the last character
+        if (width < E.screen_cols) {
+            terminal_write_string("\x1b[K");
+        }
+        terminal_write_string("\r\n");
     }
     
-    // Status line
+    // Status line on the last row, in reverse video
     char status[80];
-    int len = snprintf(status, sizeof(status), "%.20s - %zu bytes %zu,%zu",
+    snprintf(status, sizeof(status), "\x1b[7m%s - %u bytes %u,%u\x1b[K\x1b[0m",
         E.filename ? E.filename : "[No Name]", 
-        E.buffer_size,
-        E.cursor_y + 1,
-        E.cursor_x + 1);
-    
-    if (len > (int)E.screen_cols) len = E.screen_cols;
-    
-    // Move to last line and print status
-    terminal_movecursor(0, E.screen_rows);
+        (unsigned)E.buffer_size,
+        (unsigned)(E.cursor_y + 1),
+        (unsigned)(E.cursor_x + 1));
     terminal_write_string(status);
     
     // Move cursor back to editing position
-    terminal_movecursor(E.cursor_x, E.cursor_y);
+    char position[24];
+    snprintf(position, sizeof(position), "\x1b[%u;%uH\x1b[?25h",
+        (unsigned)(E.cursor_y + 1), (unsigned)(E.cursor_x + 1));
+    terminal_write_string(position);
+    terminal_end_update();
 }
 
 void editor_compile_and_run() {
@@ -186,19 +247,46 @@ void editor_compile_and_run() {
     }
 }
 
-void editor_process_keypress() {
-    char c = keyboard_getchar();
-    if (!c) return;  // No character available
-    
+// Show the kernel log and interrupt statistics until the next key
+static void editor_show_log() {
+    terminal_begin_update();
+    terminal_write_string("\x1b[2J\x1b[H");
+    klog_dump(terminal_write_string);
+    terminal_write_string("\r\nInterrupts:\r\n");
+    interrupts_dump_stats(terminal_write_string);
+    terminal_end_update();
+}
+
+// Next typed character from the keyboard or the serial console; 0 when
+// both are empty. Page keys are handled here since they only move the
+// terminal's scrollback view.
+static char editor_next_char() {
+    struct key_event event;
+    while (keyboard_poll_event(&event)) {
+        if (!event.pressed) continue;
+
+        if (event.keycode == KEYCODE_PGUP) {
+            terminal_scroll_view(E.screen_rows);
+            continue;
+        }
+        if (event.keycode == KEYCODE_PGDN) {
+            terminal_scroll_view(-(int)E.screen_rows);
+            continue;
+        }
+        char c = keyboard_event_char(&event);
+        if (c) return c;
+    }
+
+    // Accept input from a serial console too
+    char c = serial_getchar();
+    if (c == 0x7F) c = 0x08;  // DEL from terminal emulators
+    return c;
+}
+
+// Apply one command key. Returns false if the screen must not be
+// redrawn over what the command displayed.
+static bool editor_handle_key(char c) {
     switch (c) {
-        case '\r':  // Enter key
-        case '\n':
-            editor_insert_char('\n');
-            E.cursor_x = 0;
-            E.cursor_y++;
-            E.is_modified = true;
-            break;
-            
         case 0x08:  // Backspace
             editor_delete_char();
             E.is_modified = true;
@@ -218,7 +306,7 @@ void editor_process_keypress() {
             break;
             
         case 19:  // Ctrl-S
-            if (E.filename && E.buffer) {
+            if (E.filename && E.buffer && !E.is_mapped) {
                 write_file(E.filename, E.buffer, E.buffer_size);
                 terminal_write_string("\r\nFile saved.\r\n");
                 E.is_modified = false;
@@ -228,14 +316,82 @@ void editor_process_keypress() {
         case 18:  // Ctrl-R
             editor_compile_and_run();
             break;
-            
-        default:
-            if (c >= 32 && c < 127) {
-                editor_insert_char(c);
-                E.is_modified = true;
+
+        case 4:  // Ctrl-D
+            editor_show_log();
+            return false;
+    }
+    return true;
+}
+
+#if EDITOR_FRAME_TICKS > 0
+static void editor_frame_wake(void* ctx) {
+    (void)ctx;  // Unused parameter
+}
+#endif
+
+// Cap the redraw rate. With tickless idle nothing else need wake the
+// CPU, so a deferred frame arms a timer; its interrupt ends the idle
+// halt and the frame is drawn on the next pass.
+static bool editor_frame_due() {
+#if EDITOR_FRAME_TICKS > 0
+    static uint32_t last_frame = 0;
+    static struct timer frame_timer;
+    uint32_t now = kernel_get_ticks();
+    uint32_t since = now - last_frame;
+    if (since < EDITOR_FRAME_TICKS) {
+        if (!timer_pending(&frame_timer)) {
+            uint32_t wait_ms = ((EDITOR_FRAME_TICKS - since) * 1000 + TIMER_HZ - 1) / TIMER_HZ;
+            timer_add(&frame_timer, wait_ms, editor_frame_wake, nullptr);
+        }
+        return false;
+    }
+    last_frame = now;
+#endif
+    return true;
+}
+
+// Drain all pending input, then redraw once. Typed text is gathered into
+// runs so a paste costs one buffer copy per run rather than per key.
+void editor_process_keypress() {
+    static bool redraw_pending = false;
+
+    char run[EDITOR_INSERT_RUN];
+    size_t run_length = 0;
+    bool typed = false;
+
+    char c;
+    while ((c = editor_next_char()) != 0) {
+        if (!typed) {
+            // Any key returns to the live screen
+            terminal_reset_view();
+            typed = true;
+        }
+        if (c == '\r') c = '\n';  // Enter key
+        if (c == '\n' || (c >= 32 && c < 127)) {
+            run[run_length++] = c;
+            if (run_length == EDITOR_INSERT_RUN) {
+                editor_insert_text(run, run_length);
+                run_length = 0;
             }
-            break;
+            E.is_modified = true;
+            redraw_pending = true;
+            continue;
+        }
+
+        editor_insert_text(run, run_length);
+        run_length = 0;
+        if (!editor_handle_key(c)) {
+            // Leave the rest of the input for after the display is dismissed
+            redraw_pending = false;
+            return;
+        }
+        redraw_pending = true;
+    }
+    editor_insert_text(run, run_length);
+
+    if (redraw_pending && editor_frame_due()) {
+        editor_refresh_screen();
+        redraw_pending = false;
     }
-    
-    editor_refresh_screen();
 }
@@ -28,6 +28,7 @@ void editor_init(void);
 void editor_refresh_screen(void);
 void editor_open(const char* filename);
 void editor_insert_char(char c);
+void editor_insert_text(const char* text, size_t length);
 void editor_process_keypress(void);
 
 #ifdef __cplusplus
@@ -0,0 +1,289 @@
+#include "console.h"
+#include "font.h"
+#include "multiboot.h"
+#include "paging.h"
+#include "memory.h"
+#include "string.h"
+#include "klog.h"
+
+// The framebuffer is mapped at a fixed window above the file mappings
+#define FBCON_VIRT_BASE   0xE0000000
+#define FBCON_VIRT_LIMIT  0x4000000
+
+// Font rows are doubled to give 8x16 cells
+#define GLYPH_WIDTH  FONT_WIDTH
+#define GLYPH_HEIGHT (FONT_HEIGHT * 2)
+
+// Pre-rendered glyphs, direct mapped by cell (character and attribute)
+#define GLYPH_CACHE_LOG   9
+#define GLYPH_CACHE_SLOTS (1 << GLYPH_CACHE_LOG)
+
+#define CURSOR_LINES 2
+
+// Largest pixel the row blit handles, in bytes
+#define FB_MAX_PIXEL 4
+
+// Glyphs hold pixel values in the framebuffer's own format, stored in
+// 32 bits whatever the depth
+struct glyph_slot {
+    uint16_t cell;
+    bool valid;
+    uint32_t pixels[GLYPH_HEIGHT][GLYPH_WIDTH];
+};
+
+static uint8_t* fb;
+static uint32_t fb_pitch;
+static size_t fb_pixel;     // Bytes per pixel
+static uint32_t palette[16];
+static struct glyph_slot glyph_cache[GLYPH_CACHE_SLOTS];
+
+// One pixel line of a text row, composed in RAM and copied out whole
+static uint8_t line_buffer[TERMINAL_MAX_COLS * GLYPH_WIDTH * FB_MAX_PIXEL];
+
+static size_t cursor_row;
+static size_t cursor_col;
+static bool cursor_shown = false;
+
+static void fbcon_draw_row(size_t row, const uint16_t* cells);
+static bool fbcon_scroll(int lines);
+static void fbcon_set_cursor(size_t row, size_t col, bool visible);
+
+static struct console_driver fb_driver = {
+    0, 0, fbcon_draw_row, fbcon_scroll, fbcon_set_cursor
+};
+
+// Standard VGA text colours as 0xRRGGBB
+static const uint32_t vga_rgb[16] = {
+    0x000000, 0x0000AA, 0x00AA00, 0x00AAAA, 0xAA0000, 0xAA00AA, 0xAA5500, 0xAAAAAA,
+    0x555555, 0x5555FF, 0x55FF55, 0x55FFFF, 0xFF5555, 0xFF55FF, 0xFFFF55, 0xFFFFFF
+};
+
+static uint32_t pack_channel(uint32_t value, uint8_t position, uint8_t size) {
+    return (value >> (8 - size)) << position;
+}
+
+static void render_glyph(struct glyph_slot* slot, uint16_t cell) {
+    uint8_t c = cell & 0xFF;
+    uint32_t fg = palette[(cell >> 8) & 0x0F];
+    uint32_t bg = palette[(cell >> 12) & 0x0F];
+    const uint8_t* bits = (c >= FONT_FIRST && c <= FONT_LAST) ? font8x8[c - FONT_FIRST] : font8x8[0];
+
+    for (size_t y = 0; y < GLYPH_HEIGHT; y++) {
+        uint8_t line = bits[y / 2];
+        for (size_t x = 0; x < GLYPH_WIDTH; x++) {
+            slot->pixels[y][x] = (line & (0x80 >> x)) ? fg : bg;
+        }
+    }
+    slot->cell = cell;
+    slot->valid = true;
+}
+
+static const uint32_t* glyph_pixels(uint16_t cell) {
+    struct glyph_slot* slot = &glyph_cache[(uint16_t)(cell * 40503u) >> (16 - GLYPH_CACHE_LOG)];
+    if (!slot->valid || slot->cell != cell) {
+        render_glyph(slot, cell);
+    }
+    return &slot->pixels[0][0];
+}
+
+static uint8_t* pixel_line(size_t y) {
+    return fb + y * fb_pitch;
+}
+
+// Invert the bottom lines of the cursor cell; doing it twice restores it
+static void invert_cursor() {
+    size_t y = (cursor_row + 1) * GLYPH_HEIGHT - CURSOR_LINES;
+    for (size_t i = 0; i < CURSOR_LINES; i++) {
+        uint8_t* p = pixel_line(y + i) + cursor_col * GLYPH_WIDTH * fb_pixel;
+        for (size_t x = 0; x < GLYPH_WIDTH * fb_pixel; x++) {
+            p[x] ^= 0xFF;
+        }
+    }
+}
+
+// Store one glyph line in the framebuffer's pixel size; returns the end
+static uint8_t* put_pixels(uint8_t* out, const uint32_t* src) {
+    switch (fb_pixel) {
+        case 4:
+            memcpy(out, src, GLYPH_WIDTH * sizeof(uint32_t));
+            break;
+        case 3:
+            for (size_t x = 0; x < GLYPH_WIDTH; x++) {
+                out[x * 3] = (uint8_t)src[x];
+                out[x * 3 + 1] = (uint8_t)(src[x] >> 8);
+                out[x * 3 + 2] = (uint8_t)(src[x] >> 16);
+            }
+            break;
+        case 2:
+            for (size_t x = 0; x < GLYPH_WIDTH; x++) {
+                uint16_t v = (uint16_t)src[x];
+                memcpy(out + x * 2, &v, sizeof(v));
+            }
+            break;
+        default:
+            for (size_t x = 0; x < GLYPH_WIDTH; x++) {
+                out[x] = (uint8_t)src[x];
+            }
+            break;
+    }
+    return out + GLYPH_WIDTH * fb_pixel;
+}
+
+static void fbcon_draw_row(size_t row, const uint16_t* cells) {
+    const uint32_t* glyphs[TERMINAL_MAX_COLS];
+    size_t cols = fb_driver.cols;
+    for (size_t col = 0; col < cols; col++) {
+        glyphs[col] = glyph_pixels(cells[col]);
+    }
+
+    for (size_t y = 0; y < GLYPH_HEIGHT; y++) {
+        uint8_t* out = line_buffer;
+        for (size_t col = 0; col < cols; col++) {
+            out = put_pixels(out, glyphs[col] + y * GLYPH_WIDTH);
+        }
+        memcpy(pixel_line(row * GLYPH_HEIGHT + y), line_buffer, cols * GLYPH_WIDTH * fb_pixel);
+    }
+
+    if (cursor_shown && row == cursor_row) {
+        cursor_shown = false;  // Drawn over
+    }
+}
+
+static bool fbcon_scroll(int lines) {
+    if (cursor_shown) {
+        invert_cursor();
+        cursor_shown = false;
+    }
+
+    size_t shift = (lines < 0 ? -lines : lines) * GLYPH_HEIGHT * fb_pitch;
+    size_t span = fb_driver.rows * GLYPH_HEIGHT * fb_pitch - shift;
+    if (lines > 0) {
+        memmove(fb, fb + shift, span);
+    } else {
+        memmove(fb + shift, fb, span);
+    }
+    return true;
+}
+
+static void fbcon_set_cursor(size_t row, size_t col, bool visible) {
+    if (cursor_shown && (!visible || row != cursor_row || col != cursor_col)) {
+        invert_cursor();
+        cursor_shown = false;
+    }
+    if (visible && !cursor_shown) {
+        cursor_row = row;
+        cursor_col = col;
+        invert_cursor();
+        cursor_shown = true;
+    }
+}
+
+// Palette entry closest to an 0xRRGGBB colour
+static uint32_t nearest_index(uint32_t rgb, const uint8_t* entries, size_t count) {
+    uint32_t best = 0;
+    uint32_t best_distance = 0xFFFFFFFF;
+    for (size_t i = 0; i < count; i++) {
+        int dr = (int)(rgb >> 16) - entries[i * 3];
+        int dg = (int)((rgb >> 8) & 0xFF) - entries[i * 3 + 1];
+        int db = (int)(rgb & 0xFF) - entries[i * 3 + 2];
+        uint32_t distance = dr * dr + dg * dg + db * db;
+        if (distance < best_distance) {
+            best_distance = distance;
+            best = i;
+        }
+    }
+    return best;
+}
+
+// Fill the 16-colour palette in the mode's pixel format. Returns false,
+// logging why, for formats the console can't draw in.
+static bool build_palette(const struct multiboot_info* info) {
+    uint8_t bpp = info->framebuffer.bpp;
+
+    if (info->framebuffer.type == MULTIBOOT_FRAMEBUFFER_TYPE_RGB) {
+        if ((bpp != 15 && bpp != 16 && bpp != 24 && bpp != 32) ||
+            info->framebuffer.red_mask_size > 8 || info->framebuffer.green_mask_size > 8 ||
+            info->framebuffer.blue_mask_size > 8) {
+            klog(KLOG_ERR, "fbcon: unsupported %u bpp RGB mode", (unsigned)bpp);
+            return false;
+        }
+        for (size_t i = 0; i < 16; i++) {
+            uint32_t rgb = vga_rgb[i];
+            palette[i] = pack_channel(rgb >> 16, info->framebuffer.red_field_position, info->framebuffer.red_mask_size) |
+                         pack_channel((rgb >> 8) & 0xFF, info->framebuffer.green_field_position, info->framebuffer.green_mask_size) |
+                         pack_channel(rgb & 0xFF, info->framebuffer.blue_field_position, info->framebuffer.blue_mask_size);
+        }
+        return true;
+    }
+
+    if (info->framebuffer.type == MULTIBOOT_FRAMEBUFFER_TYPE_INDEXED) {
+        // The bootloader's palette table sits in identity-mapped memory
+        size_t count = info->framebuffer.color_count;
+        uintptr_t table = info->framebuffer.palette_addr;
+        if (bpp != 8 || count == 0 || count > 256 ||
+            table + count * 3 > PAGING_IDENTITY_LIMIT) {
+            klog(KLOG_ERR, "fbcon: unsupported %u bpp indexed mode (%u colours)",
+                 (unsigned)bpp, (unsigned)count);
+            return false;
+        }
+        for (size_t i = 0; i < 16; i++) {
+            palette[i] = nearest_index(vga_rgb[i], (const uint8_t*)table, count);
+        }
+        return true;
+    }
+
+    klog(KLOG_ERR, "fbcon: unknown framebuffer type %u", (unsigned)info->framebuffer.type);
+    return false;
+}
+
+const struct console_driver* fbcon_init(const struct multiboot_info* info) {
+    // No framebuffer, or a text mode the VGA driver handles
+    if (!(info->flags & MULTIBOOT_INFO_FRAMEBUFFER) ||
+        info->framebuffer.type == MULTIBOOT_FRAMEBUFFER_TYPE_EGA_TEXT) {
+        return nullptr;
+    }
+    if (info->framebuffer.addr >> 32) {
+        klog(KLOG_ERR, "fbcon: framebuffer above 4 GiB");
+        return nullptr;
+    }
+    if (!build_palette(info)) {
+        return nullptr;
+    }
+    fb_pixel = (info->framebuffer.bpp + 7) / 8;
+
+    uintptr_t phys = (uintptr_t)info->framebuffer.addr;
+    size_t offset = phys & (PAGE_SIZE - 1);
+    size_t height = info->framebuffer.height;
+    fb_pitch = info->framebuffer.pitch;
+    if (offset + (size_t)fb_pitch * height > FBCON_VIRT_LIMIT) {
+        height = (FBCON_VIRT_LIMIT - offset) / fb_pitch;
+    }
+
+    // If the page tables run out, use the lines that did get mapped
+    size_t mapped = 0;
+    while (mapped < offset + (size_t)fb_pitch * height) {
+        if (paging_map_page(FBCON_VIRT_BASE + mapped, phys - offset + mapped, PAGE_WRITABLE) < 0) {
+            size_t lines = mapped > offset ? (mapped - offset) / fb_pitch : 0;
+            klog(KLOG_WARN, "fbcon: mapped %u of %u lines", (unsigned)lines, (unsigned)height);
+            height = lines;
+            break;
+        }
+        mapped += PAGE_SIZE;
+    }
+    size_t fb_size = (size_t)fb_pitch * height;
+    fb = (uint8_t*)FBCON_VIRT_BASE + offset;
+
+    size_t cols = info->framebuffer.width / GLYPH_WIDTH;
+    size_t rows = height / GLYPH_HEIGHT;
+    fb_driver.cols = cols < TERMINAL_MAX_COLS ? cols : TERMINAL_MAX_COLS;
+    fb_driver.rows = rows < TERMINAL_MAX_ROWS ? rows : TERMINAL_MAX_ROWS;
+    if (fb_driver.cols == 0 || fb_driver.rows == 0) {
+        klog(KLOG_ERR, "fbcon: %ux%u mode too small for text", (unsigned)info->framebuffer.width, (unsigned)height);
+        return nullptr;
+    }
+
+    // Clear the margins the text grid does not cover. Black is 0 in RGB
+    // modes; an indexed mode uses the palette's closest entry.
+    memset(fb, fb_pixel == 1 ? palette[0] : 0, fb_size);
+    return &fb_driver;
+}
@@ -1,13 +1,38 @@
 #include "filesystem.h"
 #include "kernel.h"
 #include "string.h"
+#include "memory.h"
+#include "lz.h"
+#include "crc32c.h"
+#include "klog.h"
 #include <stddef.h>
 
+// Raw blocks are handed out as page frames for file mappings
+static_assert(FS_BLOCK_SIZE == PAGE_SIZE, "file blocks must be page sized");
+
+// Only keep a compressed block if it saves at least this fraction
+#define FS_MIN_SAVINGS_SHIFT 3
+
 // File system storage
 static struct File files[MAX_FILES];
 static size_t num_files = 0;
 
+// Codec scratch space; one block is encoded or decoded at a time
+static uint8_t block_scratch[FS_BLOCK_SIZE];
+static uint8_t compress_scratch[LZ_COMPRESS_BOUND(FS_BLOCK_SIZE)];
+
+// Codec throughput counters
+static uint64_t encode_bytes = 0;
+static uint64_t encode_cycles = 0;
+static uint64_t decode_bytes = 0;
+static uint64_t decode_cycles = 0;
+
+// Blocks whose stored bytes failed CRC verification
+static uint32_t checksum_errors = 0;
+
 void filesystem_init() {
+    crc32c_init();
+
     // Initialize all file slots as unused
     for (size_t i = 0; i < MAX_FILES; i++) {
         files[i].used = false;
@@ -15,6 +40,154 @@ void filesystem_init() {
     num_files = 0;
 }
 
+static struct File* find_file(const char* filename) {
+    for (size_t i = 0; i < MAX_FILES; i++) {
+        if (files[i].used && strcmp(files[i].name, filename) == 0) {
+            return &files[i];
+        }
+    }
+    return nullptr;
+}
+
+static size_t block_length(const struct File* file, size_t index) {
+    size_t start = index * FS_BLOCK_SIZE;
+    if (start >= file->size) {
+        return 0;
+    }
+    size_t length = file->size - start;
+    return length < FS_BLOCK_SIZE ? length : FS_BLOCK_SIZE;
+}
+
+static void release_block(struct FileBlock* block) {
+    if (block->compressed) {
+        free(block->data);
+    } else {
+        page_free(block->data);
+    }
+    page_free(block->cache);
+    block->data = nullptr;
+    block->cache = nullptr;
+    block->crc = 0;
+    block->stored = 0;
+    block->compressed = false;
+}
+
+// Check a block's stored bytes against the CRC recorded when written
+static bool verify_block(const struct FileBlock* block) {
+    if (crc32c(block->data, block->stored) == block->crc) {
+        return true;
+    }
+    checksum_errors++;
+    klog(KLOG_ERR, "filesystem: block checksum mismatch (%u stored bytes)", (unsigned)block->stored);
+    return false;
+}
+
+static void release_blocks(struct File* file) {
+    for (size_t i = 0; i < FS_BLOCKS_PER_FILE; i++) {
+        release_block(&file->blocks[i]);
+    }
+}
+
+// Encode one block into new storage, compressing it if the file asks for
+// it and it pays off. The file itself is not changed.
+static int encode_block(const struct File* file, const uint8_t* data, size_t length,
+                        struct FileBlock* block) {
+    const uint8_t* payload = data;
+    size_t stored = length;
+    bool compressed = false;
+
+    if (file->flags & FILE_FLAG_COMPRESSED) {
+        uint64_t start = rdtsc();
+        size_t packed = lz_compress(data, length, compress_scratch, sizeof(compress_scratch));
+        encode_cycles += rdtsc() - start;
+        encode_bytes += length;
+
+        if (packed && packed <= length - (length >> FS_MIN_SAVINGS_SHIFT)) {
+            payload = compress_scratch;
+            stored = packed;
+            compressed = true;
+        }
+    }
+
+    uint8_t* storage;
+    if (compressed) {
+        storage = (uint8_t*)malloc(stored);
+        if (!storage) {
+            return -1;
+        }
+        memcpy(storage, payload, stored);
+    } else {
+        storage = (uint8_t*)page_alloc();
+        if (!storage) {
+            return -1;
+        }
+        memcpy(storage, payload, stored);
+        memset(storage + stored, 0, FS_BLOCK_SIZE - stored);
+    }
+
+    block->data = storage;
+    block->cache = nullptr;
+    block->crc = crc32c(storage, stored);
+    block->stored = (uint16_t)stored;
+    block->compressed = compressed;
+    return 0;
+}
+
+// Replace a block with an encoded one; cannot fail
+static void install_block(struct File* file, size_t index, const struct FileBlock* encoded) {
+    release_block(&file->blocks[index]);
+    file->blocks[index] = *encoded;
+}
+
+static int store_block(struct File* file, size_t index, const uint8_t* data, size_t length) {
+    struct FileBlock encoded;
+    if (encode_block(file, data, length, &encoded) != 0) {
+        return -1;
+    }
+    install_block(file, index, &encoded);
+    return 0;
+}
+
+// Return a pointer to the decoded contents of one block. Raw blocks are
+// returned in place; compressed blocks are decoded into block_scratch.
+static const uint8_t* load_block(const struct File* file, size_t index) {
+    const struct FileBlock* block = &file->blocks[index];
+    if (block->compressed && block->cache) {
+        return block->cache;
+    }
+    if (!verify_block(block)) {
+        return nullptr;
+    }
+    if (!block->compressed) {
+        return block->data;
+    }
+
+    size_t length = block_length(file, index);
+    uint64_t start = rdtsc();
+    int decoded = lz_decompress(block->data, block->stored, block_scratch, sizeof(block_scratch));
+    decode_cycles += rdtsc() - start;
+    decode_bytes += length;
+
+    if (decoded != (int)length) {
+        return nullptr;
+    }
+    return block_scratch;
+}
+
+static int store_file_data(struct File* file, const uint8_t* data, size_t size) {
+    release_blocks(file);
+    file->size = size;
+
+    for (size_t i = 0; i * FS_BLOCK_SIZE < size; i++) {
+        if (store_block(file, i, data + i * FS_BLOCK_SIZE, block_length(file, i)) != 0) {
+            release_blocks(file);
+            file->size = 0;
+            return -1;
+        }
+    }
+    return 0;
+}
+
 int create_file(const char* filename) {
     if (!filename || strlen(filename) >= MAX_FILENAME_LENGTH) {
         return -1;
@@ -32,7 +205,16 @@ int create_file(const char* filename) {
         if (!files[i].used) {
             strncpy(files[i].name, filename, MAX_FILENAME_LENGTH - 1);
             files[i].name[MAX_FILENAME_LENGTH - 1] = '\0';
+            for (size_t b = 0; b < FS_BLOCKS_PER_FILE; b++) {
+                files[i].blocks[b].data = nullptr;
+                files[i].blocks[b].cache = nullptr;
+                files[i].blocks[b].crc = 0;
+                files[i].blocks[b].stored = 0;
+                files[i].blocks[b].compressed = false;
+            }
             files[i].size = 0;
+            files[i].flags = 0;
+            files[i].map_count = 0;
             files[i].used = true;
             num_files++;
             return 0;
@@ -47,47 +229,135 @@ int write_file(const char* filename, const uint8_t* data, size_t size) {
         return -1;
     }
 
-    // Find file
-    for (size_t i = 0; i < MAX_FILES; i++) {
-        if (files[i].used && strcmp(files[i].name, filename) == 0) {
-            memcpy(files[i].data, data, size);
-            files[i].size = size;
-            return 0;
+    // Find file, creating it if needed
+    struct File* file = find_file(filename);
+    if (!file) {
+        if (create_file(filename) != 0) {
+            return -1;
         }
+        file = find_file(filename);
+    }
+    if (file->map_count) {
+        return -1;  // Mapped files are read-only
     }
 
-    // File not found, try to create it
-    if (create_file(filename) != 0) {
+    return store_file_data(file, data, size);
+}
+
+int read_file(const char* filename, uint8_t* buffer, size_t* size) {
+    if (!filename || !buffer || !size) {
         return -1;
     }
 
-    // Write to newly created file
-    for (size_t i = 0; i < MAX_FILES; i++) {
-        if (files[i].used && strcmp(files[i].name, filename) == 0) {
-            memcpy(files[i].data, data, size);
-            files[i].size = size;
-            return 0;
+    struct File* file = find_file(filename);
+    if (!file) {
+        return -1;  // File not found
+    }
+
+    for (size_t i = 0; i * FS_BLOCK_SIZE < file->size; i++) {
+        const uint8_t* block = load_block(file, i);
+        if (!block) {
+            return -1;
         }
+        memcpy(buffer + i * FS_BLOCK_SIZE, block, block_length(file, i));
     }
+    *size = file->size;
+    return 0;
+}
 
-    return -1;
+// Read part of a file, decoding only the blocks the range touches
+extern "C" int read_file_range(const char* filename, size_t offset, uint8_t* buffer, size_t length) {
+    if (!filename || !buffer) {
+        return -1;
+    }
+
+    struct File* file = find_file(filename);
+    if (!file) {
+        return -1;
+    }
+    return file_read_at(file, offset, buffer, length);
 }
 
-int read_file(const char* filename, uint8_t* buffer, size_t* size) {
-    if (!filename || !buffer || !size) {
+// Write part of a file, creating or extending it as needed
+extern "C" int write_file_range(const char* filename, size_t offset, const uint8_t* data, size_t length) {
+    if (!filename || !data) {
         return -1;
     }
 
-    // Find file
-    for (size_t i = 0; i < MAX_FILES; i++) {
-        if (files[i].used && strcmp(files[i].name, filename) == 0) {
-            memcpy(buffer, files[i].data, files[i].size);
-            *size = files[i].size;
-            return 0;
+    struct File* file = find_file(filename);
+    if (!file) {
+        if (create_file(filename) != 0) {
+            return -1;
+        }
+        file = find_file(filename);
+    }
+    return file_write_at(file, offset, data, length);
+}
+
+int file_read_at(struct File* file, size_t offset, uint8_t* buffer, size_t length) {
+    if (offset >= file->size) {
+        return 0;
+    }
+    if (length > file->size - offset) {
+        length = file->size - offset;
+    }
+
+    size_t done = 0;
+    while (done < length) {
+        size_t index = (offset + done) / FS_BLOCK_SIZE;
+        size_t within = (offset + done) % FS_BLOCK_SIZE;
+        size_t chunk = block_length(file, index) - within;
+        if (chunk > length - done) {
+            chunk = length - done;
+        }
+
+        const uint8_t* block = load_block(file, index);
+        if (!block) {
+            return -1;
         }
+        memcpy(buffer + done, block + within, chunk);
+        done += chunk;
+    }
+    return (int)done;
+}
+
+// Switch a file between raw and compressed storage, re-encoding its data
+extern "C" int file_set_compression(const char* filename, bool enabled) {
+    if (!filename) {
+        return -1;
     }
 
-    return -1;  // File not found
+    struct File* file = find_file(filename);
+    if (!file) {
+        return -1;
+    }
+    if (((file->flags & FILE_FLAG_COMPRESSED) != 0) == enabled) {
+        return 0;
+    }
+    if (file->map_count) {
+        return -1;
+    }
+
+    if (enabled) {
+        file->flags |= FILE_FLAG_COMPRESSED;
+    } else {
+        file->flags &= ~FILE_FLAG_COMPRESSED;
+    }
+
+    for (size_t i = 0; i * FS_BLOCK_SIZE < file->size; i++) {
+        const uint8_t* block = load_block(file, i);
+        if (!block) {
+            return -1;
+        }
+        // store_block frees the storage a raw block was returned from
+        if (block != block_scratch) {
+            memcpy(block_scratch, block, block_length(file, i));
+        }
+        if (store_block(file, i, block_scratch, block_length(file, i)) != 0) {
+            return -1;
+        }
+    }
+    return 0;
 }
 
 extern "C" char* read_file(const char* filename) {
@@ -101,14 +371,43 @@ extern "C" char* read_file(const char* filename) {
 }
 
 extern "C" int write_file(const char* filename, const char* data, size_t size) {
-    if (!filename || !data || size == 0) {
+    return write_file(filename, (const uint8_t*)data, size);
+}
+
+int delete_file(const char* filename) {
+    struct File* file = file_lookup(filename);
+    if (!file || file->map_count) {
         return -1;
     }
-    // TODO: Implement actual file writing
-    // For now, just return success
+
+    release_blocks(file);
+    file->size = 0;
+    file->used = false;
+    num_files--;
     return 0;
 }
 
+// Call fn for every file in use; returns the number visited
+size_t file_foreach(void (*fn)(const struct File* file, void* ctx), void* ctx) {
+    size_t visited = 0;
+    for (size_t i = 0; i < MAX_FILES && visited < num_files; i++) {
+        if (files[i].used) {
+            fn(&files[i], ctx);
+            visited++;
+        }
+    }
+    return visited;
+}
+
+static void print_file_info(const struct File* file, void* ctx) {
+    (void)ctx;
+    char info[MAX_FILENAME_LENGTH + 32];
+    snprintf(info, sizeof(info), "  %s (%u bytes)%s\n", 
+            file->name, (unsigned)file->size,
+            (file->flags & FILE_FLAG_COMPRESSED) ? " [lz]" : "");
+    terminal_write_string(info);
+}
+
 void list_files() {
     terminal_write_string("Files:\n");
     
@@ -117,14 +416,7 @@ void list_files() {
         return;
     }
 
-    for (size_t i = 0; i < MAX_FILES; i++) {
-        if (files[i].used) {
-            char info[MAX_FILENAME_LENGTH + 32];
-            snprintf(info, sizeof(info), "  %s (%u bytes)\n", 
-                    files[i].name, (unsigned)files[i].size);
-            terminal_write_string(info);
-        }
-    }
+    file_foreach(print_file_info, nullptr);
 }
 
 bool file_exists(const char* filename) {
@@ -138,3 +430,187 @@ bool file_exists(const char* filename) {
 
     return false;
 }
+
+void fs_get_compression_stats(struct fs_compression_stats* stats) {
+    stats->logical_bytes = 0;
+    stats->stored_bytes = 0;
+
+    for (size_t i = 0; i < MAX_FILES; i++) {
+        if (!files[i].used || !(files[i].flags & FILE_FLAG_COMPRESSED)) {
+            continue;
+        }
+        stats->logical_bytes += files[i].size;
+        for (size_t b = 0; b < FS_BLOCKS_PER_FILE; b++) {
+            stats->stored_bytes += files[i].blocks[b].stored;
+        }
+    }
+
+    stats->encode_bytes = encode_bytes;
+    stats->encode_cycles = encode_cycles;
+    stats->decode_bytes = decode_bytes;
+    stats->decode_cycles = decode_cycles;
+}
+
+// Bytes per thousand cycles, scaled down to stay in 32-bit arithmetic
+static unsigned bytes_per_kcycle(uint64_t bytes, uint64_t cycles) {
+    while (cycles > 0xFFFFFFFFu || bytes > 0xFFFFFFFFu / 1000) {
+        cycles >>= 1;
+        bytes >>= 1;
+    }
+    if (cycles == 0) {
+        return 0;
+    }
+    return (uint32_t)bytes * 1000 / (uint32_t)cycles;
+}
+
+uint32_t fs_checksum_errors() {
+    return checksum_errors;
+}
+
+void fs_print_compression_stats() {
+    struct fs_compression_stats stats;
+    fs_get_compression_stats(&stats);
+
+    char info[80];
+    unsigned percent = stats.logical_bytes ?
+        stats.stored_bytes * 100u / stats.logical_bytes : 100;
+    snprintf(info, sizeof(info), "Compression: %d -> %d bytes (%d%%)\n",
+             (int)stats.logical_bytes, (int)stats.stored_bytes, (int)percent);
+    terminal_write_string(info);
+
+    snprintf(info, sizeof(info), "  encode: %d bytes/kcycle\n",
+             (int)bytes_per_kcycle(stats.encode_bytes, stats.encode_cycles));
+    terminal_write_string(info);
+    snprintf(info, sizeof(info), "  decode: %d bytes/kcycle\n",
+             (int)bytes_per_kcycle(stats.decode_bytes, stats.decode_cycles));
+    terminal_write_string(info);
+}
+
+struct File* file_lookup(const char* filename) {
+    if (!filename) {
+        return nullptr;
+    }
+    return find_file(filename);
+}
+
+size_t file_get_size(const char* filename) {
+    struct File* file = file_lookup(filename);
+    return file ? file->size : 0;
+}
+
+// Page frame holding a block's contents. Raw blocks are mapped as-is;
+// compressed blocks are decoded once into a cached frame.
+void* file_block_page(struct File* file, size_t index) {
+    if (index >= FS_BLOCKS_PER_FILE) {
+        return nullptr;
+    }
+
+    struct FileBlock* block = &file->blocks[index];
+    if (!block->data) {
+        return nullptr;
+    }
+    if (block->compressed && block->cache) {
+        return block->cache;
+    }
+    if (!verify_block(block)) {
+        return nullptr;
+    }
+    if (!block->compressed) {
+        return block->data;
+    }
+
+    uint8_t* page = (uint8_t*)page_alloc();
+    if (!page) {
+        return nullptr;
+    }
+    size_t length = block_length(file, index);
+    uint64_t start = rdtsc();
+    int decoded = lz_decompress(block->data, block->stored, page, PAGE_SIZE);
+    decode_cycles += rdtsc() - start;
+    decode_bytes += length;
+    if (decoded != (int)length) {
+        page_free(page);
+        return nullptr;
+    }
+    memset(page + length, 0, PAGE_SIZE - length);
+
+    block->cache = page;
+    return page;
+}
+
+void file_pin(struct File* file) {
+    file->map_count++;
+}
+
+// Drop a mapping reference; the last one releases the decoded page cache
+void file_unpin(struct File* file) {
+    if (file->map_count == 0 || --file->map_count) {
+        return;
+    }
+    for (size_t i = 0; i < FS_BLOCKS_PER_FILE; i++) {
+        page_free(file->blocks[i].cache);
+        file->blocks[i].cache = nullptr;
+    }
+}
+
+// Re-encode only the blocks the range touches. Blocks between the old
+// end of file and offset are zero-filled. Every block is encoded before
+// any is replaced, so a failed write leaves the file as it was.
+int file_write_at(struct File* file, size_t offset, const uint8_t* data, size_t length) {
+    if (file->map_count || offset > MAX_FILE_SIZE || length > MAX_FILE_SIZE - offset) {
+        return -1;
+    }
+    if (length == 0) {
+        return 0;
+    }
+
+    size_t end = offset + length;
+    size_t new_size = end > file->size ? end : file->size;
+    size_t first = (offset < file->size ? offset : file->size) / FS_BLOCK_SIZE;
+    size_t last = (end - 1) / FS_BLOCK_SIZE;
+    struct FileBlock staged[FS_BLOCKS_PER_FILE];
+    size_t ready = first;   // Blocks before this one are staged
+
+    for (size_t i = first; i <= last; i++) {
+        size_t block_start = i * FS_BLOCK_SIZE;
+        size_t old_length = block_length(file, i);
+        if (old_length) {
+            const uint8_t* block = load_block(file, i);
+            if (!block) {
+                break;
+            }
+            if (block != block_scratch) {
+                memcpy(block_scratch, block, old_length);
+            }
+        }
+        memset(block_scratch + old_length, 0, FS_BLOCK_SIZE - old_length);
+
+        size_t from = offset > block_start ? offset : block_start;
+        size_t to = end < block_start + FS_BLOCK_SIZE ? end : block_start + FS_BLOCK_SIZE;
+        if (from < to) {
+            memcpy(block_scratch + (from - block_start), data + (from - offset), to - from);
+        }
+
+        size_t new_length = new_size - block_start;
+        if (new_length > FS_BLOCK_SIZE) {
+            new_length = FS_BLOCK_SIZE;
+        }
+        if (encode_block(file, block_scratch, new_length, &staged[i]) != 0) {
+            break;
+        }
+        ready = i + 1;
+    }
+
+    if (ready <= last) {
+        for (size_t i = first; i < ready; i++) {
+            release_block(&staged[i]);
+        }
+        return -1;
+    }
+
+    for (size_t i = first; i <= last; i++) {
+        install_block(file, i, &staged[i]);
+    }
+    file->size = new_size;
+    return (int)length;
+}
@@ -8,26 +8,79 @@
 extern "C" {
 #endif
 
+#ifndef MAX_FILES
 #define MAX_FILES 256
+#endif
 #define MAX_FILENAME_LENGTH 32
-#define MAX_FILE_SIZE 4096
+#define FS_BLOCK_SIZE 4096
+#define FS_BLOCKS_PER_FILE 16
+#define MAX_FILE_SIZE (FS_BLOCK_SIZE * FS_BLOCKS_PER_FILE)
+
+// File flags
+#define FILE_FLAG_COMPRESSED 0x01
+
+// Raw blocks are kept in page frames so they can be mapped directly;
+// compressed blocks live on the heap and are decoded into a cached page
+// frame while the file is mapped
+struct FileBlock {
+    uint8_t* data;      // nullptr until the block is written
+    uint8_t* cache;     // Decoded page of a compressed block, if any
+    uint32_t crc;       // CRC32C of the stored bytes
+    uint16_t stored;    // Bytes held at data
+    bool compressed;
+};
 
 struct File {
     char name[MAX_FILENAME_LENGTH];
-    uint8_t data[MAX_FILE_SIZE];
+    struct FileBlock blocks[FS_BLOCKS_PER_FILE];
     size_t size;
+    uint32_t flags;
+    uint16_t map_count; // Live mappings; the file is read-only while set
     bool used;
 };
 
+struct fs_compression_stats {
+    uint32_t logical_bytes;     // Data held in compressed-mode files
+    uint32_t stored_bytes;      // RAM those files actually occupy
+    uint64_t encode_bytes;
+    uint64_t encode_cycles;
+    uint64_t decode_bytes;
+    uint64_t decode_cycles;
+};
+
 void filesystem_init(void);
 int create_file(const char* filename);
 char* read_file(const char* filename);
 int write_file(const char* filename, const char* data, size_t size);
+int read_file_range(const char* filename, size_t offset, uint8_t* buffer, size_t length);
+// Returns length, or -1 leaving the file's contents and size unchanged
+int write_file_range(const char* filename, size_t offset, const uint8_t* data, size_t length);
+int file_set_compression(const char* filename, bool enabled);
+int delete_file(const char* filename);
 void list_files(void);
+size_t file_foreach(void (*fn)(const struct File* file, void* ctx), void* ctx);
 bool file_exists(const char* filename);
+void fs_get_compression_stats(struct fs_compression_stats* stats);
+void fs_print_compression_stats(void);
+uint32_t fs_checksum_errors(void);
+
+// Page-level access used by file mappings
+struct File* file_lookup(const char* filename);
+size_t file_get_size(const char* filename);
+void* file_block_page(struct File* file, size_t index);
+void file_pin(struct File* file);
+void file_unpin(struct File* file);
+
+// Offset-based access on an already looked-up file. Writes, as with
+// write_file_range(), apply completely or not at all.
+int file_read_at(struct File* file, size_t offset, uint8_t* buffer, size_t length);
+int file_write_at(struct File* file, size_t offset, const uint8_t* data, size_t length);
 
 #ifdef __cplusplus
 }
+
+int write_file(const char* filename, const uint8_t* data, size_t size);
+int read_file(const char* filename, uint8_t* buffer, size_t* size);
 #endif
 
 #endif /* FILESYSTEM_H */
@@ -0,0 +1,23 @@
+#ifndef FONT_H
+#define FONT_H
+
+#include <stdint.h>
+
+// 8x8 bitmap font for printable ASCII. Each glyph is eight rows, top
+// first, with the leftmost pixel in the most significant bit.
+#define FONT_WIDTH  8
+#define FONT_HEIGHT 8
+#define FONT_FIRST  0x20
+#define FONT_LAST   0x7E
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern const uint8_t font8x8[FONT_LAST - FONT_FIRST + 1][FONT_HEIGHT];
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FONT_H
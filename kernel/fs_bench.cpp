@@ -0,0 +1,124 @@
+#include "fs_bench.h"
+#include "filesystem.h"
+#include "string.h"
+
+// Only benchmark builds carry the code and its buffer; the host build
+// defines KERNEL_FS_BENCH too
+#ifdef KERNEL_FS_BENCH
+
+#define FS_BENCH_SMALL_WRITE 64
+#define FS_BENCH_LARGE_WRITE (4 * FS_BLOCK_SIZE)
+#define FS_BENCH_MIN_OPS     10000
+
+static const size_t bench_sizes[] = { 10, 100, 1000, 10000 };
+
+static uint8_t bench_data[FS_BENCH_LARGE_WRITE];
+
+static void bench_name(char* name, const char* prefix, size_t index) {
+    snprintf(name, MAX_FILENAME_LENGTH, "%s%d", prefix, (int)index);
+}
+
+static void count_file(const struct File* file, void* ctx) {
+    (void)file;
+    (*(size_t*)ctx)++;
+}
+
+// Average per operation without 64-bit division
+static uint32_t per_op(uint64_t total, size_t ops) {
+    unsigned shift = 0;
+    while (total > 0xFFFFFFFFu) {
+        total >>= 1;
+        shift++;
+    }
+    return ((uint32_t)total / (uint32_t)ops) << shift;
+}
+
+static void report(const struct fs_bench_env* env, const char* op,
+                   size_t files, uint64_t elapsed, size_t ops) {
+    char line[96];
+    snprintf(line, sizeof(line), "  %s files=%d: %d %s/op (%d ops)\n",
+             op, (int)files, (int)per_op(elapsed, ops), env->unit, (int)ops);
+    env->print(line);
+}
+
+static void bench_size(const struct fs_bench_env* env, size_t files) {
+    char name[MAX_FILENAME_LENGTH];
+    size_t passes = files < FS_BENCH_MIN_OPS ? FS_BENCH_MIN_OPS / files : 1;
+    uint64_t start;
+
+    start = env->now();
+    for (size_t i = 0; i < files; i++) {
+        bench_name(name, "f", i);
+        create_file(name);
+    }
+    report(env, "create      ", files, env->now() - start, files);
+
+    start = env->now();
+    for (size_t p = 0; p < passes; p++) {
+        for (size_t i = 0; i < files; i++) {
+            bench_name(name, "f", i);
+            file_exists(name);
+        }
+    }
+    report(env, "lookup-hit  ", files, env->now() - start, files * passes);
+
+    start = env->now();
+    for (size_t p = 0; p < passes; p++) {
+        for (size_t i = 0; i < files; i++) {
+            bench_name(name, "m", i);
+            file_exists(name);
+        }
+    }
+    report(env, "lookup-miss ", files, env->now() - start, files * passes);
+
+    start = env->now();
+    for (size_t i = 0; i < files; i++) {
+        bench_name(name, "f", i);
+        write_file(name, bench_data, FS_BENCH_SMALL_WRITE);
+    }
+    report(env, "write-small ", files, env->now() - start, files);
+
+    start = env->now();
+    for (size_t i = 0; i < files; i++) {
+        bench_name(name, "f", i);
+        write_file(name, bench_data, FS_BENCH_LARGE_WRITE);
+    }
+    report(env, "write-large ", files, env->now() - start, files);
+
+    size_t listed = 0;
+    start = env->now();
+    for (size_t p = 0; p < passes; p++) {
+        file_foreach(count_file, &listed);
+    }
+    report(env, "list        ", files, env->now() - start, listed ? listed : 1);
+
+    for (size_t i = 0; i < files; i++) {
+        bench_name(name, "f", i);
+        delete_file(name);
+    }
+}
+
+void fs_bench_run(const struct fs_bench_env* env) {
+    char line[96];
+
+    // Compressible but not trivial payload
+    for (size_t i = 0; i < sizeof(bench_data); i++) {
+        bench_data[i] = (uint8_t)("int main() { return 0; }\n"[i % 25] + (i / 997));
+    }
+
+    // Lookups scan the whole table, so misses cost the same at any count
+    snprintf(line, sizeof(line), "Filesystem benchmark (%d file slots)\n", (int)MAX_FILES);
+    env->print(line);
+    for (size_t s = 0; s < sizeof(bench_sizes) / sizeof(bench_sizes[0]); s++) {
+        size_t files = bench_sizes[s];
+        if (files > MAX_FILES) {
+            snprintf(line, sizeof(line), "  files=%d: skipped (MAX_FILES=%d)\n",
+                     (int)files, (int)MAX_FILES);
+            env->print(line);
+            continue;
+        }
+        bench_size(env, files);
+    }
+}
+
+#endif // KERNEL_FS_BENCH
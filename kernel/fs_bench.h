@@ -0,0 +1,28 @@
+#ifndef FS_BENCH_H
+#define FS_BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Platform hooks, so the same benchmark runs in the kernel (clock_ns,
+// serial output) and in the host build (CLOCK_MONOTONIC, stdout)
+struct fs_bench_env {
+    uint64_t (*now)(void);
+    const char* unit;
+    void (*print)(const char* text);
+};
+
+// Measure create, lookup hit/miss, small/large write and list cost at
+// 10, 100, 1000 and 10000 files. Sizes above MAX_FILES are skipped.
+// Built only with KERNEL_FS_BENCH.
+void fs_bench_run(const struct fs_bench_env* env);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FS_BENCH_H
@@ -1,13 +1,21 @@
 #include "interrupts.h"
 #include "kernel.h"
-#include "keyboard.h"
+#include "string.h"
+#include "klog.h"
+#include "apic.h"
+#include "clock.h"
 #include <stddef.h>
-#include <string.h>
 
-// Forward declarations
-void int_to_string(int num, char* str);
-static void timer_handler(struct registers* regs);
-void keyboard_handler(struct registers* regs);
+// PIC ports and commands
+#define PIC1_COMMAND 0x20
+#define PIC1_DATA    0x21
+#define PIC2_COMMAND 0xA0
+#define PIC2_DATA    0xA1
+#define PIC_EOI      0x20
+
+// Interrupt gate, present, ring 0
+#define IDT_GATE_FLAGS 0x8E
+#define KERNEL_CODE_SELECTOR 0x08
 
 // IDT entry structure
 struct idt_entry {
@@ -24,12 +32,50 @@ struct idt_ptr {
     uint32_t base;
 } __attribute__((packed));
 
+struct interrupt_slot {
+    interrupt_handler_t handler;
+    void* ctx;
+};
+
 // IDT array
-static struct idt_entry idt[256];
+static struct idt_entry idt[INTERRUPT_VECTORS];
 static struct idt_ptr idtp;
 
-// Timer variables
-static volatile uint32_t tick = 0;
+// Handlers, hit counters and cycle histograms, indexed by vector
+static struct interrupt_slot handlers[INTERRUPT_VECTORS];
+static uint32_t hits[INTERRUPT_VECTORS];
+static struct interrupt_profile profiles[INTERRUPT_VECTORS];
+
+// Vector whose handler is running, for interrupt_record_latency()
+static uint32_t current_vector = 0;
+
+#ifdef KERNEL_IRQ_TRACE
+static bool irq_off_open = false;       // Inside a traced region
+static uint64_t irq_off_start = 0;
+static uint32_t irq_off_from = 0;
+static struct irq_off_stats irq_off;
+#endif
+
+// Set once the local and I/O APICs have taken over from the PIC
+static bool apic_mode = false;
+
+// Scheduled tasklets, newest first, and whether a runner is active
+static struct tasklet* tasklet_queue = nullptr;
+static bool tasklets_running = false;
+
+// Stub addresses from isr.asm
+extern "C" const uint32_t interrupt_stub_table[INTERRUPT_VECTORS];
+
+static const char* const exception_names[32] = {
+    "divide error", "debug", "NMI", "breakpoint",
+    "overflow", "bound range exceeded", "invalid opcode", "device not available",
+    "double fault", "coprocessor segment overrun", "invalid TSS", "segment not present",
+    "stack fault", "general protection fault", "page fault", "reserved",
+    "x87 floating point", "alignment check", "machine check", "SIMD floating point",
+    "virtualization", "control protection", "reserved", "reserved",
+    "reserved", "reserved", "reserved", "reserved",
+    "hypervisor injection", "VMM communication", "security", "reserved"
+};
 
 // Function to set an IDT gate
 static void idt_set_gate(uint8_t num, uint32_t base, uint16_t sel, uint8_t flags) {
@@ -40,89 +86,345 @@ static void idt_set_gate(uint8_t num, uint32_t base, uint16_t sel, uint8_t flags
     idt[num].flags = flags;
 }
 
-// External assembly functions
-extern "C" {
-    void idt_load(struct idt_ptr* ptr);
-    void isr0();
-    void isr1();
-    void irq0();
-    void irq1();
+extern "C" int register_interrupt_handler(uint8_t vector, interrupt_handler_t handler, void* ctx) {
+    if (!handler || handlers[vector].handler) {
+        return -1;
+    }
+    handlers[vector].ctx = ctx;
+    // Publish the handler last so dispatch never sees it with a stale ctx
+    __atomic_store_n(&handlers[vector].handler, handler, __ATOMIC_RELEASE);
+    return 0;
+}
+
+extern "C" void unregister_interrupt_handler(uint8_t vector) {
+    __atomic_store_n(&handlers[vector].handler, (interrupt_handler_t)nullptr, __ATOMIC_RELEASE);
 }
 
-// Timer handler implementation
-static void timer_handler(struct registers* regs) {
-    (void)regs; // Unused parameter
-    tick++;
+extern "C" uint32_t interrupt_hits(uint8_t vector) {
+    return __atomic_load_n(&hits[vector], __ATOMIC_RELAXED);
 }
 
-// ISR handlers
-extern "C" void isr_handler(struct registers* regs) {
-    // Handle CPU exceptions here
-    if (regs->int_no < 32) {
-        char num_str[12];
-        int_to_string(regs->int_no, num_str);
-        kernel_panic(num_str);
+static inline uint32_t cycles_since(uint64_t start) {
+    uint64_t cycles = rdtsc() - start;
+    return cycles > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)cycles;
+}
+
+static inline void histogram_add(uint32_t* buckets, uint32_t cycles) {
+    unsigned bucket = cycles ? 31 - __builtin_clz(cycles) : 0;
+    if (bucket >= INTERRUPT_HIST_BUCKETS) {
+        bucket = INTERRUPT_HIST_BUCKETS - 1;
     }
+    buckets[bucket]++;
+}
+
+extern "C" void interrupt_record_latency(uint32_t cycles) {
+    histogram_add(profiles[current_vector].latency, cycles);
+}
+
+extern "C" void interrupt_get_profile(uint8_t vector, struct interrupt_profile* profile) {
+    uint32_t flags = irq_save();
+    *profile = profiles[vector];
+    irq_restore(flags);
 }
 
-extern "C" void irq_handler(struct registers* regs) {
-    // Send EOI signal to PICs
-    if (regs->int_no >= 40) {
-        outb(0xA0, 0x20);
+#ifdef KERNEL_IRQ_TRACE
+// Not inlined, so the return address is the io.h helper's call site
+extern "C" __attribute__((noinline)) void irq_trace_off() {
+    if (irq_off_open) {
+        return;
     }
-    outb(0x20, 0x20);
+    irq_off_open = true;
+    irq_off_from = (uint32_t)__builtin_return_address(0);
+    irq_off_start = rdtsc();
+}
 
-    // Handle IRQs
-    switch (regs->int_no - 32) {
-        case 0:  // Timer
-            timer_handler(regs);
-            break;
-        case 1:  // Keyboard
-            keyboard_handler(regs);
-            break;
+extern "C" __attribute__((noinline)) void irq_trace_on() {
+    if (!irq_off_open) {
+        return;
+    }
+    uint32_t cycles = cycles_since(irq_off_start);
+    irq_off_open = false;
+    histogram_add(irq_off.regions, cycles);
+    if (cycles > irq_off.longest) {
+        irq_off.longest = cycles;
+        irq_off.longest_from = irq_off_from;
+        irq_off.longest_to = (uint32_t)__builtin_return_address(0);
     }
 }
+#endif
+
+extern "C" bool irq_off_get_stats(struct irq_off_stats* stats) {
+#ifdef KERNEL_IRQ_TRACE
+    uint32_t flags = irq_save();
+    *stats = irq_off;
+    irq_restore(flags);
+    return true;
+#else
+    (void)stats;  // Unused parameter
+    return false;
+#endif
+}
+
+// One line listing the non-empty buckets as 2^n:count
+static void print_histogram(const char* label, const uint32_t* buckets,
+                            void (*print)(const char* line)) {
+    char line[32 + INTERRUPT_HIST_BUCKETS * 16];
+    size_t length = snprintf(line, sizeof(line), "  %s", label);
+    bool empty = true;
+    for (unsigned i = 0; i < INTERRUPT_HIST_BUCKETS; i++) {
+        if (buckets[i]) {
+            length += snprintf(line + length, sizeof(line) - length, " 2^%u:%u",
+                               i, (unsigned)buckets[i]);
+            empty = false;
+        }
+    }
+    if (!empty) {
+        snprintf(line + length, sizeof(line) - length, "\n");
+        print(line);
+    }
+}
+
+extern "C" void interrupts_dump_stats(void (*print)(const char* line)) {
+    char line[96];
+    snprintf(line, sizeof(line), "(log2 cycles at %u kHz)\n", (unsigned)clock_tsc_khz());
+    print(line);
+
+    struct interrupt_profile profile;
+    for (unsigned vector = 0; vector < INTERRUPT_VECTORS; vector++) {
+        uint32_t count = interrupt_hits(vector);
+        if (count) {
+            snprintf(line, sizeof(line), "vector %u: %u\n", vector, (unsigned)count);
+            print(line);
+            interrupt_get_profile(vector, &profile);
+            print_histogram("run", profile.handler, print);
+            print_histogram("late", profile.latency, print);
+        }
+    }
+
+    struct irq_off_stats stats;
+    if (irq_off_get_stats(&stats) && stats.longest) {
+        uint32_t khz = clock_tsc_khz();
+        uint32_t us = khz ? (uint32_t)clock_div_u64((uint64_t)stats.longest * 1000, khz, nullptr) : 0;
+        snprintf(line, sizeof(line), "irqs off: longest %u cycles (%u us), 0x%x to 0x%x\n",
+                 (unsigned)stats.longest, (unsigned)us,
+                 (unsigned)stats.longest_from, (unsigned)stats.longest_to);
+        print(line);
+        print_histogram("off", stats.regions, print);
+    }
+}
+
+extern "C" void tasklet_init(struct tasklet* tasklet, void (*fn)(void* ctx), void* ctx) {
+    tasklet->next = nullptr;
+    tasklet->fn = fn;
+    tasklet->ctx = ctx;
+    tasklet->scheduled = false;
+}
+
+extern "C" void tasklet_schedule(struct tasklet* tasklet) {
+    uint32_t flags = irq_save();
+    if (!tasklet->scheduled) {
+        tasklet->scheduled = true;
+        tasklet->next = tasklet_queue;
+        tasklet_queue = tasklet;
+    }
+    irq_restore(flags);
+}
+
+extern "C" bool tasklets_pending() {
+    return __atomic_load_n(&tasklet_queue, __ATOMIC_RELAXED) != nullptr;
+}
+
+// Run up to rounds batches of scheduled tasklets with interrupts
+// enabled. Called with interrupts disabled and returns with them
+// disabled. Interrupts that arrive meanwhile only queue more work.
+static void run_tasklets(unsigned rounds) {
+    if (tasklets_running) {
+        return;
+    }
+    tasklets_running = true;
+
+    while (rounds-- && tasklet_queue) {
+        // Take the batch and put it in scheduling order
+        struct tasklet* batch = nullptr;
+        for (struct tasklet* t = tasklet_queue; t; ) {
+            struct tasklet* next = t->next;
+            t->next = batch;
+            batch = t;
+            t = next;
+        }
+        tasklet_queue = nullptr;
+
+        while (batch) {
+            struct tasklet* t = batch;
+            batch = t->next;
+            t->scheduled = false;   // May be scheduled again while it runs
+            irq_enable();
+            t->fn(t->ctx);
+            irq_disable();
+        }
+    }
+
+    tasklets_running = false;
+}
+
+extern "C" void tasklets_run() {
+    uint32_t flags = irq_save();
+    run_tasklets(TASKLET_MAX_ROUNDS);
+    irq_restore(flags);
+}
+
+static void unhandled_exception(struct registers* regs) {
+    char message[64];
+    snprintf(message, sizeof(message), "%s (error 0x%x at 0x%x)",
+             exception_names[regs->int_no], (unsigned)regs->err_code, (unsigned)regs->eip);
+    kernel_panic(message);
+}
+
+extern "C" void interrupt_dispatch(struct registers* regs) {
+    uint64_t entry = rdtsc();
+    uint32_t vector = regs->int_no & (INTERRUPT_VECTORS - 1);
+    hits[vector]++;
+
+    // Signal end of interrupt: one MMIO write with the APIC, one or two
+    // port writes with the PIC. Spurious APIC interrupts take no EOI.
+    if (apic_mode) {
+        if ((vector >= IRQ0 && vector <= IRQ15) || vector == APIC_TIMER_VECTOR) {
+            lapic_eoi();
+        }
+    } else if (vector >= IRQ0 && vector <= IRQ15) {
+        if (vector >= IRQ8) {
+            outb(PIC2_COMMAND, PIC_EOI);
+        }
+        outb(PIC1_COMMAND, PIC_EOI);
+    }
+
+    // An exception may arrive while another handler runs
+    uint32_t outer_vector = current_vector;
+    current_vector = vector;
+    interrupt_handler_t handler = __atomic_load_n(&handlers[vector].handler, __ATOMIC_ACQUIRE);
+    if (handler) {
+        handler(regs, handlers[vector].ctx);
+    } else if (vector < 32) {
+        unhandled_exception(regs);
+    }
+    current_vector = outer_vector;
+    histogram_add(profiles[vector].handler, cycles_since(entry));
+
+    // Bottom halves run on the way out, but only where the interrupted
+    // code itself had interrupts enabled
+    if (regs->eflags & EFLAGS_IF) {
+        if (tasklet_queue) {
+            run_tasklets(TASKLET_MAX_ROUNDS);
+        }
+        irq_trace_on();     // iret enables them again
+    }
+}
+
+#ifdef KERNEL_IRQ_BENCH
+// Vectors nothing else uses; the full one matches isr.asm
+#define INTERRUPT_BENCH_VECTOR      0xF0
+#define INTERRUPT_BENCH_FULL_VECTOR 0xF1
+#define INTERRUPT_BENCH_ROUNDS_LOG  12
+
+extern "C" void interrupt_bench_full_stub();
+
+static void bench_handler(struct registers* regs, void* ctx) {
+    (void)regs;  // Unused parameters
+    (void)ctx;
+}
+
+// Average cycles for one int instruction round trip through vector
+template <uint8_t vector>
+static uint32_t bench_vector() {
+    uint64_t start = rdtsc();
+    for (unsigned i = 0; i < (1u << INTERRUPT_BENCH_ROUNDS_LOG); i++) {
+        asm volatile("int %0" : : "i"(vector) : "memory");
+    }
+    return (uint32_t)(rdtsc() - start) >> INTERRUPT_BENCH_ROUNDS_LOG;
+}
+
+extern "C" void interrupts_bench() {
+    idt_set_gate(INTERRUPT_BENCH_FULL_VECTOR, (uint32_t)interrupt_bench_full_stub,
+                 KERNEL_CODE_SELECTOR, IDT_GATE_FLAGS);
+    register_interrupt_handler(INTERRUPT_BENCH_VECTOR, bench_handler, nullptr);
+    register_interrupt_handler(INTERRUPT_BENCH_FULL_VECTOR, bench_handler, nullptr);
+
+    // Warm up both paths before timing them
+    bench_vector<INTERRUPT_BENCH_VECTOR>();
+    bench_vector<INTERRUPT_BENCH_FULL_VECTOR>();
+    uint32_t fast = bench_vector<INTERRUPT_BENCH_VECTOR>();
+    uint32_t full = bench_vector<INTERRUPT_BENCH_FULL_VECTOR>();
+    klog(KLOG_INFO, "interrupt round trip: %u cycles, %u with full entry", fast, full);
+
+    unregister_interrupt_handler(INTERRUPT_BENCH_VECTOR);
+    unregister_interrupt_handler(INTERRUPT_BENCH_FULL_VECTOR);
+    idt_set_gate(INTERRUPT_BENCH_FULL_VECTOR, interrupt_stub_table[INTERRUPT_BENCH_FULL_VECTOR],
+                 KERNEL_CODE_SELECTOR, IDT_GATE_FLAGS);
+}
+#endif
 
 // Initialize PIC
 static void pic_init() {
     // Remap PIC
-    outb(0x20, 0x11);
-    outb(0xA0, 0x11);
-    outb(0x21, 0x20);
-    outb(0xA1, 0x28);
-    outb(0x21, 0x04);
-    outb(0xA1, 0x02);
-    outb(0x21, 0x01);
-    outb(0xA1, 0x01);
-    outb(0x21, 0x0);
-    outb(0xA1, 0x0);
+    outb(PIC1_COMMAND, 0x11);
+    outb(PIC2_COMMAND, 0x11);
+    outb(PIC1_DATA, IRQ0);
+    outb(PIC2_DATA, IRQ8);
+    outb(PIC1_DATA, 0x04);
+    outb(PIC2_DATA, 0x02);
+    outb(PIC1_DATA, 0x01);
+    outb(PIC2_DATA, 0x01);
+    outb(PIC1_DATA, 0x0);
+    outb(PIC2_DATA, 0x0);
+}
+
+extern "C" void irq_set_masked(unsigned irq, bool masked) {
+    if (irq >= 16) {
+        return;
+    }
+    if (apic_mode) {
+        ioapic_set_masked(irq, masked);
+        return;
+    }
+    uint16_t port = irq < 8 ? PIC1_DATA : PIC2_DATA;
+    uint8_t bit = 1 << (irq & 7);
+    uint32_t flags = irq_save();
+    uint8_t mask = inb(port);
+    outb(port, masked ? (mask | bit) : (mask & ~bit));
+    irq_restore(flags);
 }
 
 // Initialize interrupt descriptor table
 extern "C" void interrupts_init() {
     // Set up IDT pointer
-    idtp.limit = (sizeof(struct idt_entry) * 256) - 1;
+    idtp.limit = (sizeof(struct idt_entry) * INTERRUPT_VECTORS) - 1;
     idtp.base = (uint32_t)&idt;
 
-    // Clear IDT
-    memset(&idt, 0, sizeof(struct idt_entry) * 256);
-
-    // Initialize PIC
+    // Remap the PIC even when the APICs take over, so a spurious PIC
+    // interrupt can't land on an exception vector. Build with
+    // KERNEL_FORCE_PIC to keep using it.
     pic_init();
+#ifndef KERNEL_FORCE_PIC
+    apic_mode = apic_init();
+#endif
+    if (apic_mode) {
+        outb(PIC1_DATA, 0xFF);
+        outb(PIC2_DATA, 0xFF);
+    } else {
+        klog(KLOG_INFO, "interrupts: using the 8259 PIC");
+    }
 
-    // Set up ISR gates
-    idt_set_gate(0, (uint32_t)isr0, 0x08, 0x8E);
-    idt_set_gate(1, (uint32_t)isr1, 0x08, 0x8E);
-
-    // Set up IRQ gates
-    idt_set_gate(32, (uint32_t)irq0, 0x08, 0x8E);  // Timer
-    idt_set_gate(33, (uint32_t)irq1, 0x08, 0x8E);  // Keyboard
+    // Every vector gets a stub; ones without a handler are counted and
+    // ignored, or panic if they are CPU exceptions
+    for (unsigned vector = 0; vector < INTERRUPT_VECTORS; vector++) {
+        idt_set_gate(vector, interrupt_stub_table[vector], KERNEL_CODE_SELECTOR, IDT_GATE_FLAGS);
+    }
 
     // Load IDT
     idt_load(&idtp);
 
     // Enable interrupts
-    asm volatile("sti");
+    irq_enable();
 }
 
 // Helper function to convert int to string
@@ -31,26 +31,104 @@ struct registers {
     uint32_t eip, cs, eflags, useresp, ss;
 };
 
+#define INTERRUPT_VECTORS 256
+
+// CPU exceptions with handlers elsewhere in the kernel
+#define VECTOR_PAGE_FAULT 14
+
+// Vector a PIC line is remapped to
+#define IRQ_VECTOR(irq) (IRQ0 + (irq))
+
+// Called with interrupts disabled; ctx is the pointer given at registration
+typedef void (*interrupt_handler_t)(struct registers* regs, void* ctx);
+
+// Deferred work. A handler (the top half) acknowledges its device and
+// schedules a tasklet; the tasklet (the bottom half) runs once the
+// handler returns, with interrupts enabled, and never concurrently with
+// itself or other tasklets.
+struct tasklet {
+    struct tasklet* next;
+    void (*fn)(void* ctx);
+    void* ctx;
+    bool scheduled;         // Queued and not yet started
+};
+
+// Tasklet batches run per interrupt before the rest is left to the
+// kernel's main loop
+#define TASKLET_MAX_ROUNDS 4
+
+// Log2 cycle histograms: bucket n counts samples of 2^n up to 2^(n+1)
+// cycles. The first bucket also takes 0 and the last everything longer.
+#define INTERRUPT_HIST_BUCKETS 24
+
+struct interrupt_profile {
+    uint32_t handler[INTERRUPT_HIST_BUCKETS];   // Dispatch entry to handler return
+    uint32_t latency[INTERRUPT_HIST_BUCKETS];   // Raise to handler, where the device tells
+};
+
+// Regions with interrupts disabled through the io.h helpers. Handlers
+// entered through interrupt gates are covered by their profile instead.
+struct irq_off_stats {
+    uint32_t regions[INTERRUPT_HIST_BUCKETS];
+    uint32_t longest;           // Cycles
+    uint32_t longest_from;      // Code address that disabled interrupts
+    uint32_t longest_to;        // And the one that enabled them again
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 // Assembly functions
-extern "C" void idt_load(struct idt_ptr* ptr);
-extern "C" void isr0();
-extern "C" void isr1();
-extern "C" void irq0();
-extern "C" void irq1();
+struct idt_ptr;
+void idt_load(struct idt_ptr* ptr);
+
+// Entry point from the assembly stubs
+void interrupt_dispatch(struct registers* regs);
+
+// Install the handler for a vector; returns -1 if one is already set.
+// Handlers may be registered before interrupts_init().
+int register_interrupt_handler(uint8_t vector, interrupt_handler_t handler, void* ctx);
+void unregister_interrupt_handler(uint8_t vector);
+
+// Mask or unmask an ISA IRQ line at whichever controller routes it
+void irq_set_masked(unsigned irq, bool masked);
+
+// Queue a tasklet to run; no effect if it is already queued. Safe from
+// any context, including the tasklet itself.
+void tasklet_init(struct tasklet* tasklet, void (*fn)(void* ctx), void* ctx);
+void tasklet_schedule(struct tasklet* tasklet);
+
+// Run queued tasklets from the main loop, for work an interrupt exit
+// left behind
+bool tasklets_pending(void);
+void tasklets_run(void);
 
-// C handlers
-void isr_handler(struct registers* regs);
-void irq_handler(struct registers* regs);
+// Times each vector has been raised since boot
+uint32_t interrupt_hits(uint8_t vector);
+void interrupts_dump_stats(void (*print)(const char* line));
+
+// Record, from a handler, how many cycles ago its interrupt was raised.
+// Only devices that count from the raise can tell, such as the local
+// APIC timer.
+void interrupt_record_latency(uint32_t cycles);
+
+// Copy a vector's histograms since boot
+void interrupt_get_profile(uint8_t vector, struct interrupt_profile* profile);
+
+// Copy the interrupts-off statistics; returns false unless built with
+// KERNEL_IRQ_TRACE, which tracks them
+bool irq_off_get_stats(struct irq_off_stats* stats);
 
 // Initialization
-extern "C" void interrupts_init();
+void interrupts_init(void);
+
+// Cycles per software interrupt through the fast entry path and the old
+// full one, logged at KLOG_INFO. Built with KERNEL_IRQ_BENCH.
+void interrupts_bench(void);
 
 #ifdef __cplusplus
 }
 #endif
 
-#endif
+#endif
\ No newline at end of file
@@ -13,4 +13,79 @@ static inline uint8_t inb(uint16_t port) {
     return ret;
 }
 
+static inline void cpuid(uint32_t leaf, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx) {
+    asm volatile("cpuid" : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx) : "a"(leaf), "c"(0));
+}
+
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    asm volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+    asm volatile("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// EFLAGS interrupt enable bit
+#define EFLAGS_IF 0x200
+
+#ifdef KERNEL_IRQ_TRACE
+// Mark the start and end of a region with interrupts disabled; both are
+// called with interrupts off. They feed the longest-region tracker in
+// interrupts.cpp.
+#ifdef __cplusplus
+extern "C" {
+#endif
+void irq_trace_off(void);
+void irq_trace_on(void);
+#ifdef __cplusplus
+}
+#endif
+#else
+static inline void irq_trace_off(void) {}
+static inline void irq_trace_on(void) {}
+#endif
+
+// Disable interrupts, returning the previous EFLAGS for irq_restore()
+static inline uint32_t irq_save(void) {
+    uint32_t flags;
+    asm volatile("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    if (flags & EFLAGS_IF) {
+        irq_trace_off();
+    }
+    return flags;
+}
+
+static inline void irq_restore(uint32_t flags) {
+    if (flags & EFLAGS_IF) {
+        irq_trace_on();
+    }
+    asm volatile("push %0; popf" : : "r"(flags) : "memory", "cc");
+}
+
+static inline void irq_disable(void) {
+    asm volatile("cli" ::: "memory");
+    irq_trace_off();
+}
+
+static inline void irq_enable(void) {
+    irq_trace_on();
+    asm volatile("sti" ::: "memory");
+}
+
+// Enable interrupts and sleep until the next one. sti takes effect only
+// after the following instruction, so an IRQ that becomes pending after
+// a check made with interrupts off still ends the hlt.
+static inline void cpu_idle(void) {
+    irq_trace_on();
+    asm volatile("sti; hlt" ::: "memory");
+}
+
 #endif
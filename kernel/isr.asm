@@ -1,15 +1,9 @@
-; ISR and IRQ handlers
+; Interrupt entry stubs for all 256 vectors
 section .text
-global isr0
-global isr1
-global irq0
-global irq1
 global idt_load
-global isr_common_stub
-global irq_common_stub
+global interrupt_stub_table
 
-extern isr_handler
-extern irq_handler
+extern interrupt_dispatch
 
 ; Load IDT
 idt_load:
@@ -20,78 +14,102 @@ idt_load:
     pop ebp
     ret
 
-; ISR handlers
-isr0:
-    cli
-    push byte 0     ; Push dummy error code
-    push byte 0     ; Push interrupt number
-    jmp isr_common_stub
-
-isr1:
-    cli
-    push byte 0     ; Push dummy error code
-    push byte 1     ; Push interrupt number
-    jmp isr_common_stub
+; One stub per vector. Exceptions 8, 10-14, 17, 21, 29 and 30 come with
+; a CPU error code; the others push a dummy one to keep the frame uniform.
+; Interrupt gates already clear IF, so the stubs don't need cli.
+%assign vector 0
+%rep 256
+isr_stub_%+vector:
+%if !(vector == 8 || (vector >= 10 && vector <= 14) || vector == 17 || vector == 21 || vector == 29 || vector == 30)
+    push byte 0
+%endif
+%if vector < 128
+    push byte vector    ; Short form; it sign-extends, so only below 128
+%else
+    push dword vector
+%endif
+    jmp interrupt_common_stub
+%assign vector vector + 1
+%endrep
 
-; IRQ handlers
-irq0:
-    cli
-    push byte 0     ; Push dummy error code
-    push byte 32    ; Push interrupt number
-    jmp irq_common_stub
+; Common stub: builds a struct registers and passes its address. The
+; kernel runs in ring 0 with flat segments already loaded, so segment
+; registers are only reloaded when the interrupted code ran at another
+; privilege level. iret restores IF from the saved EFLAGS.
+interrupt_common_stub:
+    pusha               ; Push all registers
+    push ds             ; Save data segment
+    test byte [esp + 48], 3 ; RPL of the interrupted CS
+    jnz .other_ring
 
-irq1:
-    cli
-    push byte 0     ; Push dummy error code
-    push byte 33    ; Push interrupt number
-    jmp irq_common_stub
+    push esp            ; struct registers* argument
+    call interrupt_dispatch
+    add esp, 8          ; Argument and saved data segment
+    popa                ; Restore registers
+    add esp, 8          ; Clean up error code and interrupt number
+    iret
 
-; Common ISR stub
-isr_common_stub:
-    pusha           ; Push all registers
-    mov ax, ds      ; Save data segment
-    push eax
-    
-    mov ax, 0x10    ; Load kernel data segment
+.other_ring:
+    mov ax, 0x10        ; Load kernel data segment
     mov ds, ax
     mov es, ax
     mov fs, ax
     mov gs, ax
-    
-    call isr_handler
-    
-    pop eax         ; Restore data segment
+
+    push esp
+    call interrupt_dispatch
+    add esp, 4
+
+    pop eax             ; Restore data segment
     mov ds, ax
     mov es, ax
     mov fs, ax
     mov gs, ax
-    
-    popa            ; Restore registers
-    add esp, 8      ; Clean up error code and interrupt number
-    sti             ; Re-enable interrupts
-    iret            ; Return from interrupt
 
-; Common IRQ stub
-irq_common_stub:
-    pusha           ; Push all registers
-    mov ax, ds      ; Save data segment
+    popa
+    add esp, 8
+    iret
+
+%ifdef KERNEL_IRQ_BENCH
+; The entry path as it was before the fast path, measured against it by
+; interrupts_bench(). The vector must match INTERRUPT_BENCH_FULL_VECTOR.
+global interrupt_bench_full_stub
+interrupt_bench_full_stub:
+    cli
+    push byte 0
+    push dword 0xF1
+    pusha
+    mov ax, ds
     push eax
-    
-    mov ax, 0x10    ; Load kernel data segment
+
+    mov ax, 0x10
     mov ds, ax
     mov es, ax
     mov fs, ax
     mov gs, ax
-    
-    call irq_handler
-    
-    pop eax         ; Restore data segment
+
+    push esp
+    call interrupt_dispatch
+    add esp, 4
+
+    pop eax
     mov ds, ax
     mov es, ax
     mov fs, ax
     mov gs, ax
-    
-    popa            ; Restore registers
-    add esp, 8      ; Clean up error code and interrupt number
-    sti             ; Re-enable interrupts
-    iret            ; Return from interrupt
+
+    popa
+    add esp, 8
+    sti
+    iret
+%endif
+
+; Stub addresses indexed by vector, read by interrupts_init()
+section .rodata
+align 4
+interrupt_stub_table:
+%assign vector 0
+%rep 256
+    dd isr_stub_%+vector
+%assign vector vector + 1
+%endrep
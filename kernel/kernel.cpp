@@ -1,10 +1,19 @@
 #include "kernel.h"
+#include "console.h"
+#include "multiboot.h"
 #include "editor.h"
 #include "keyboard.h"
 #include "filesystem.h"
 #include "memory.h"
+#include "paging.h"
 #include "interrupts.h"
 #include "compiler.h"
+#include "serial.h"
+#include "fs_bench.h"
+#include "aio.h"
+#include "klog.h"
+#include "timer.h"
+#include "clock.h"
 #include <stdarg.h>
 
 extern "C" {
@@ -26,143 +35,67 @@ KernelState kernel_state = {
     .free_memory = 0
 };
 
-// Terminal functions
-static uint8_t make_color(enum vga_color fg, enum vga_color bg) {
-    return fg | bg << 4;
-}
-
-static uint16_t make_vgaentry(char c, uint8_t color) {
-    uint16_t c16 = c;
-    uint16_t color16 = color;
-    return c16 | color16 << 8;
-}
-
-void terminal_init() {
-    kernel_state.terminal_row = 0;
-    kernel_state.terminal_column = 0;
-    kernel_state.terminal_color = make_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK);
-    kernel_state.terminal_buffer = (uint16_t*) VGA_MEMORY;
-    kernel_state.is_initialized = true;
-
-    terminal_clear();
-}
-
-void terminal_clear() {
-    for (size_t y = 0; y < VGA_HEIGHT; y++) {
-        for (size_t x = 0; x < VGA_WIDTH; x++) {
-            const size_t index = y * VGA_WIDTH + x;
-            kernel_state.terminal_buffer[index] = make_vgaentry(' ', kernel_state.terminal_color);
-        }
-    }
-}
-
-void terminal_movecursor(size_t x, size_t y) {
-    uint16_t pos = y * VGA_WIDTH + x;
-    outb(0x3D4, 14);
-    outb(0x3D5, pos >> 8);
-    outb(0x3D4, 15);
-    outb(0x3D5, pos & 0xFF);
-}
-
-void terminal_set_color(enum vga_color fg, enum vga_color bg) {
-    kernel_state.terminal_color = make_color(fg, bg);
-}
-
-void terminal_write_char(char c) {
-    if (c == '\n') {
-        terminal_new_line();
-        return;
-    }
-
-    const size_t index = kernel_state.terminal_row * VGA_WIDTH + kernel_state.terminal_column;
-    kernel_state.terminal_buffer[index] = make_vgaentry(c, kernel_state.terminal_color);
-
-    if (++kernel_state.terminal_column == VGA_WIDTH) {
-        terminal_new_line();
-    }
-    
-    terminal_movecursor(kernel_state.terminal_column, kernel_state.terminal_row);
-}
-
-void terminal_write(const char* data, size_t size) {
-    for (size_t i = 0; i < size; i++) {
-        terminal_write_char(data[i]);
-    }
-}
-
-void terminal_write_string(const char* data) {
-    for (size_t i = 0; data[i] != '\0'; i++) {
-        terminal_write_char(data[i]);
-    }
-}
-
-void terminal_new_line() {
-    kernel_state.terminal_column = 0;
-    if (++kernel_state.terminal_row == VGA_HEIGHT) {
-        // Scroll up
-        for (size_t y = 1; y < VGA_HEIGHT; y++) {
-            for (size_t x = 0; x < VGA_WIDTH; x++) {
-                const size_t dst_index = (y - 1) * VGA_WIDTH + x;
-                const size_t src_index = y * VGA_WIDTH + x;
-                kernel_state.terminal_buffer[dst_index] = kernel_state.terminal_buffer[src_index];
-            }
-        }
-        // Clear last line
-        kernel_state.terminal_row--;
-        for (size_t x = 0; x < VGA_WIDTH; x++) {
-            const size_t index = kernel_state.terminal_row * VGA_WIDTH + x;
-            kernel_state.terminal_buffer[index] = make_vgaentry(' ', kernel_state.terminal_color);
-        }
-    }
-    terminal_movecursor(kernel_state.terminal_column, kernel_state.terminal_row);
-}
-
-void terminal_backspace() {
-    if (kernel_state.terminal_column > 0) {
-        kernel_state.terminal_column--;
-        const size_t index = kernel_state.terminal_row * VGA_WIDTH + kernel_state.terminal_column;
-        kernel_state.terminal_buffer[index] = make_vgaentry(' ', kernel_state.terminal_color);
-        terminal_movecursor(kernel_state.terminal_column, kernel_state.terminal_row);
-    }
-}
-
-void terminal_get_size(size_t* rows, size_t* cols) {
-    *rows = VGA_HEIGHT;
-    *cols = VGA_WIDTH;
-}
-
 // Kernel initialization
-extern "C" void kernel_init() {
+extern "C" void kernel_init(const struct multiboot_info* mbi) {
     // Initialize memory management
     memory_init();
+    paging_init();
     kernel_state.total_memory = memory_get_total();
     kernel_state.free_memory = memory_get_free();
     
-    // Initialize terminal
+    // Initialize terminal; output is mirrored to the serial port. Use
+    // the framebuffer if the bootloader set up a graphics mode.
+    serial_init();
     terminal_init();
+    const struct console_driver* fb = fbcon_init(mbi);
+    if (fb) {
+        terminal_set_driver(fb);
+    } else if ((mbi->flags & MULTIBOOT_INFO_FRAMEBUFFER) &&
+               mbi->framebuffer.type != MULTIBOOT_FRAMEBUFFER_TYPE_EGA_TEXT) {
+        // The card is not in text mode, so VGA text output won't show
+        klog(KLOG_ERR, "console: graphics mode unusable, output on serial only");
+    }
+    size_t rows, cols;
+    terminal_get_size(&rows, &cols);
+    klog(KLOG_INFO, "console: %ux%u %s", (unsigned)cols, (unsigned)rows, fb ? "framebuffer" : "VGA text");
     
     // Initialize other subsystems
     keyboard_init();
     filesystem_init();
+    clock_init();
     interrupts_init();
+    timer_init();
     compiler_init();
     editor_init();
 }
 
+// Halt until the next interrupt unless input or I/O is waiting. Every
+// source of work is fed by an interrupt, which ends the hlt; the timer
+// only interrupts once its next deadline is due.
+static void kernel_idle() {
+    irq_disable();
+    if (keyboard_available() || serial_available() || aio_pending() || tasklets_pending()) {
+        irq_enable();
+        return;
+    }
+    timer_idle_enter();
+    cpu_idle();
+    timer_idle_exit();
+}
+
 // Kernel main function
-extern "C" void kernel_main() {
+extern "C" void kernel_main(const struct multiboot_info* mbi) {
+    // Initialize kernel
+    kernel_init(mbi);
+
     terminal_clear();
     terminal_write_string("GHOST");
     for (int i = 0; i < 3; i++) {
         terminal_write_string(".");
-        // Add a small delay
-        for (volatile int j = 0; j < 10000000; j++) {}
+        sleep_ms(300);
     }
     terminal_write_string("\r\n");
     
-    // Initialize kernel
-    kernel_init();
-    
     // Show main banner
     terminal_clear();
     terminal_write_string("   ______  __  __  ____    _____ _______ \n");
@@ -184,19 +117,35 @@ extern "C" void kernel_main() {
     terminal_write_string(memstr);
     terminal_write_string(" KB free\n");
     
+#ifdef KERNEL_FS_BENCH
+    // Filesystem benchmark, reported over COM1
+    static const struct fs_bench_env bench_env = { clock_ns, "ns", serial_write_string };
+    fs_bench_run(&bench_env);
+#endif
+#ifdef KERNEL_IRQ_BENCH
+    interrupts_bench();
+#endif
+
     // Start editor
     editor_init();
     while(1) {
+        tasklets_run();
         editor_process_keypress();
+        aio_poll();
+        klog_flush();
+        kernel_idle();
     }
 }
 
 // Kernel panic function
 extern "C" [[noreturn]] void kernel_panic(const char* message) {
+    klog_flush();
     terminal_set_color(VGA_COLOR_RED, VGA_COLOR_BLACK);
     terminal_write_string("\nKERNEL PANIC: ");
     terminal_write_string(message);
     terminal_write_string("\nSystem halted.\n");
+    terminal_flush();  // Even if a batched update was in progress
+    serial_flush();
     
     while (true) {
         asm volatile("cli; hlt");
@@ -45,9 +45,11 @@ typedef struct {
     uint32_t free_memory;
 } KernelState;
 
+struct multiboot_info;
+
 // Function declarations
-void kernel_init(void);
-void kernel_main(void);
+void kernel_init(const struct multiboot_info* mbi);
+void kernel_main(const struct multiboot_info* mbi);
 void terminal_init(void);
 void terminal_clear(void);
 void terminal_set_color(enum vga_color fg, enum vga_color bg);
@@ -60,6 +62,11 @@ void terminal_get_size(size_t* rows, size_t* cols);
 void terminal_movecursor(size_t x, size_t y);
 void terminal_get_cursor(size_t* x, size_t* y);
 void terminal_set_cursor(size_t x, size_t y);
+void terminal_flush(void);
+void terminal_begin_update(void);
+void terminal_end_update(void);
+void terminal_scroll_view(int lines);
+void terminal_reset_view(void);
 uint32_t kernel_get_ticks(void);
 void interrupts_init(void);
 
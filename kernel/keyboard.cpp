@@ -1,5 +1,6 @@
 #include "keyboard.h"
 #include "kernel.h"
+#include "clock.h"
 #include <stdint.h>
 
 // Keyboard ports
@@ -12,30 +13,99 @@
 #define KEYBOARD_CMD_ENABLE   0xF4
 #define KEYBOARD_CMD_RESET    0xFF
 
-// Buffer for keyboard input
-static char keyboard_buffer[KEYBOARD_BUFFER_SIZE];
-static int buffer_start = 0;
-static int buffer_end = 0;
-static bool shift_pressed = false;
-static bool caps_lock = false;
+// Scancode prefixes and flags
+#define SCANCODE_EXTENDED     0xE0
+#define SCANCODE_PAUSE        0xE1
+#define SCANCODE_RELEASE      0x80
+#define PAUSE_SEQUENCE_LENGTH 5     // Bytes after E1 in the Pause sequence
 
-// US keyboard layout
-static const char scancode_to_ascii[] = {
-    0, 0, '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '-', '=', '\b',
+static_assert((KEYBOARD_BUFFER_SIZE & (KEYBOARD_BUFFER_SIZE - 1)) == 0, "KEYBOARD_BUFFER_SIZE must be a power of two");
+
+// Raw scancodes: the IRQ handler only reads the byte and stamps it, and
+// a tasklet decodes it later with interrupts enabled
+#define SCANCODE_RING_SIZE 64
+
+struct raw_scancode {
+    uint8_t code;
+    uint64_t timestamp;
+};
+
+static struct raw_scancode scancode_ring[SCANCODE_RING_SIZE];
+static uint32_t scancode_head = 0;  // Next byte to decode (tasklet)
+static uint32_t scancode_tail = 0;  // Next free slot (IRQ handler)
+static struct tasklet decode_tasklet;
+
+// Event queue: the decode tasklet is the only producer and kernel code
+// the only consumer, so each index has a single writer
+static struct key_event event_queue[KEYBOARD_BUFFER_SIZE];
+static uint32_t queue_head = 0;     // Next event to read (consumer)
+static uint32_t queue_tail = 0;     // Next free slot (producer)
+
+// Decoder state, touched only by the decode tasklet
+enum scancode_state {
+    SCANCODE_NORMAL,
+    SCANCODE_AFTER_E0,
+    SCANCODE_IN_PAUSE
+};
+
+static enum scancode_state decode_state = SCANCODE_NORMAL;
+static unsigned pause_bytes = 0;
+static uint8_t modifiers = 0;
+static uint8_t modifier_keys = 0;   // One bit per modifier keycode held
+
+// US layout, set 1 scancodes without a prefix
+static const uint16_t keymap[128] = {
+    0, 0x1B, '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '-', '=', '\b',
     '\t', 'q', 'w', 'e', 'r', 't', 'y', 'u', 'i', 'o', 'p', '[', ']', '\n',
-    0, 'a', 's', 'd', 'f', 'g', 'h', 'j', 'k', 'l', ';', '\'', '`',
-    0, '\\', 'z', 'x', 'c', 'v', 'b', 'n', 'm', ',', '.', '/', 0,
-    '*', 0, ' '
+    KEYCODE_LCTRL, 'a', 's', 'd', 'f', 'g', 'h', 'j', 'k', 'l', ';', '\'', '`',
+    KEYCODE_LSHIFT, '\\', 'z', 'x', 'c', 'v', 'b', 'n', 'm', ',', '.', '/', KEYCODE_RSHIFT,
+    '*', KEYCODE_LALT, ' ', KEYCODE_CAPS_LOCK,
+    KEYCODE_F1, KEYCODE_F1 + 1, KEYCODE_F1 + 2, KEYCODE_F1 + 3, KEYCODE_F1 + 4,
+    KEYCODE_F1 + 5, KEYCODE_F1 + 6, KEYCODE_F1 + 7, KEYCODE_F1 + 8, KEYCODE_F1 + 9,
+    KEYCODE_NUM_LOCK, KEYCODE_SCROLL_LOCK,
+    // Keypad, read as navigation keys
+    KEYCODE_HOME, KEYCODE_UP, KEYCODE_PGUP, '-', KEYCODE_LEFT, '5', KEYCODE_RIGHT, '+',
+    KEYCODE_END, KEYCODE_DOWN, KEYCODE_PGDN, KEYCODE_INSERT, KEYCODE_DELETE,
+    0, 0, 0, KEYCODE_F1 + 10, KEYCODE_F1 + 11
 };
 
-static const char scancode_to_ascii_shift[] = {
-    0, 0, '!', '@', '#', '$', '%', '^', '&', '*', '(', ')', '_', '+', '\b',
-    '\t', 'Q', 'W', 'E', 'R', 'T', 'Y', 'U', 'I', 'O', 'P', '{', '}', '\n',
+// Characters with Shift held, for keys whose character changes
+static const char shift_map[128] = {
+    0, 0, '!', '@', '#', '$', '%', '^', '&', '*', '(', ')', '_', '+', 0,
+    0, 'Q', 'W', 'E', 'R', 'T', 'Y', 'U', 'I', 'O', 'P', '{', '}', 0,
     0, 'A', 'S', 'D', 'F', 'G', 'H', 'J', 'K', 'L', ':', '"', '~',
-    0, '|', 'Z', 'X', 'C', 'V', 'B', 'N', 'M', '<', '>', '?', 0,
-    '*', 0, ' '
+    0, '|', 'Z', 'X', 'C', 'V', 'B', 'N', 'M', '<', '>', '?', 0
 };
 
+// Keys sent with the E0 prefix
+static uint16_t extended_keycode(uint8_t code) {
+    switch (code) {
+        case 0x1C: return '\n';            // Keypad Enter
+        case 0x1D: return KEYCODE_RCTRL;
+        case 0x35: return '/';             // Keypad slash
+        case 0x38: return KEYCODE_RALT;
+        case 0x47: return KEYCODE_HOME;
+        case 0x48: return KEYCODE_UP;
+        case 0x49: return KEYCODE_PGUP;
+        case 0x4B: return KEYCODE_LEFT;
+        case 0x4D: return KEYCODE_RIGHT;
+        case 0x4F: return KEYCODE_END;
+        case 0x50: return KEYCODE_DOWN;
+        case 0x51: return KEYCODE_PGDN;
+        case 0x52: return KEYCODE_INSERT;
+        case 0x53: return KEYCODE_DELETE;
+        default:   return 0;               // Includes the fake shifts around Print Screen
+    }
+}
+
+static inline uint32_t load_acquire(const uint32_t* p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void store_release(uint32_t* p, uint32_t v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
 // Wait for keyboard controller to be ready
 static void keyboard_wait_input() {
     while (inb(KEYBOARD_STATUS_PORT) & 2);
@@ -57,7 +127,13 @@ static uint8_t keyboard_read_data() {
     return inb(KEYBOARD_DATA_PORT);
 }
 
+static void keyboard_handler(struct registers* regs, void* ctx);
+static void keyboard_decode(void* ctx);
+
 void keyboard_init() {
+    tasklet_init(&decode_tasklet, keyboard_decode, nullptr);
+    register_interrupt_handler(IRQ_VECTOR(1), keyboard_handler, nullptr);
+
     // Reset keyboard
     keyboard_send_cmd(KEYBOARD_CMD_RESET);
     if (keyboard_read_data() != 0xFA) return;  // Acknowledge
@@ -66,76 +142,189 @@ void keyboard_init() {
     keyboard_send_cmd(KEYBOARD_CMD_ENABLE);
     if (keyboard_read_data() != 0xFA) return;  // Acknowledge
 
-    buffer_start = 0;
-    buffer_end = 0;
-    shift_pressed = false;
-    caps_lock = false;
+    queue_head = 0;
+    queue_tail = 0;
+    decode_state = SCANCODE_NORMAL;
+    modifiers = 0;
+    modifier_keys = 0;
+}
+
+// Track a modifier key; returns false for other keys
+static bool update_modifiers(uint16_t keycode, bool pressed) {
+    uint8_t key_bit;
+    switch (keycode) {
+        case KEYCODE_LSHIFT: key_bit = 0x01; break;
+        case KEYCODE_RSHIFT: key_bit = 0x02; break;
+        case KEYCODE_LCTRL:  key_bit = 0x04; break;
+        case KEYCODE_RCTRL:  key_bit = 0x08; break;
+        case KEYCODE_LALT:   key_bit = 0x10; break;
+        case KEYCODE_RALT:   key_bit = 0x20; break;
+        case KEYCODE_CAPS_LOCK:
+            if (pressed) {
+                modifiers ^= KEYMOD_CAPS;
+            }
+            return true;
+        default:
+            return false;
+    }
+
+    if (pressed) {
+        modifier_keys |= key_bit;
+    } else {
+        modifier_keys &= ~key_bit;
+    }
+    modifiers = (modifiers & KEYMOD_CAPS) |
+                ((modifier_keys & 0x03) ? KEYMOD_SHIFT : 0) |
+                ((modifier_keys & 0x0C) ? KEYMOD_CTRL : 0) |
+                ((modifier_keys & 0x30) ? KEYMOD_ALT : 0);
+    return true;
 }
 
-extern "C" void keyboard_handler(struct registers* regs) {
-    (void)regs;  // Unused parameter
+static void queue_event(uint16_t keycode, bool pressed, uint64_t timestamp) {
+    uint32_t tail = queue_tail;
+    if (tail - load_acquire(&queue_head) == KEYBOARD_BUFFER_SIZE) {
+        return;  // Full: drop the event
+    }
+    struct key_event* event = &event_queue[tail & (KEYBOARD_BUFFER_SIZE - 1)];
+    event->keycode = keycode;
+    event->modifiers = modifiers;
+    event->pressed = pressed;
+    event->timestamp = timestamp;
+    store_release(&queue_tail, tail + 1);
+}
+
+// Top half: take the byte off the controller so it can send the next
+static void keyboard_handler(struct registers* regs, void* ctx) {
+    (void)regs;  // Unused parameters
+    (void)ctx;
 
+    uint64_t timestamp = clock_ns();
     uint8_t scancode = inb(KEYBOARD_DATA_PORT);
-    
-    // Handle special keys
-    if (scancode == 0x2A || scancode == 0x36) {
-        shift_pressed = true;
-        return;
+
+    uint32_t tail = scancode_tail;
+    if (tail - load_acquire(&scancode_head) == SCANCODE_RING_SIZE) {
+        return;  // Full: drop the byte
     }
-    if (scancode == (0x2A | 0x80) || scancode == (0x36 | 0x80)) {
-        shift_pressed = false;
-        return;
+    struct raw_scancode* raw = &scancode_ring[tail & (SCANCODE_RING_SIZE - 1)];
+    raw->code = scancode;
+    raw->timestamp = timestamp;
+    store_release(&scancode_tail, tail + 1);
+    tasklet_schedule(&decode_tasklet);
+}
+
+// Turn one scancode byte into at most one event
+static void decode_scancode(uint8_t scancode, uint64_t timestamp) {
+    switch (decode_state) {
+        case SCANCODE_IN_PAUSE:
+            // Pause has no release and no use here; skip its bytes
+            if (--pause_bytes == 0) {
+                decode_state = SCANCODE_NORMAL;
+            }
+            return;
+        case SCANCODE_NORMAL:
+            if (scancode == SCANCODE_EXTENDED) {
+                decode_state = SCANCODE_AFTER_E0;
+                return;
+            }
+            if (scancode == SCANCODE_PAUSE) {
+                decode_state = SCANCODE_IN_PAUSE;
+                pause_bytes = PAUSE_SEQUENCE_LENGTH;
+                return;
+            }
+            break;
+        case SCANCODE_AFTER_E0:
+            break;
     }
-    if (scancode == 0x3A) {
-        caps_lock = !caps_lock;
+
+    bool pressed = !(scancode & SCANCODE_RELEASE);
+    uint8_t code = scancode & ~SCANCODE_RELEASE;
+    uint16_t keycode;
+    if (decode_state == SCANCODE_AFTER_E0) {
+        decode_state = SCANCODE_NORMAL;
+        keycode = extended_keycode(code);
+    } else {
+        keycode = keymap[code];
+        if (keycode && keycode < 0x80 && shift_map[code]) {
+            // Shift picks the other character; Caps Lock flips letters only
+            bool shifted = modifiers & KEYMOD_SHIFT;
+            if (keycode >= 'a' && keycode <= 'z' && (modifiers & KEYMOD_CAPS)) {
+                shifted = !shifted;
+            }
+            if (shifted) {
+                keycode = shift_map[code];
+            }
+        }
+    }
+    if (!keycode) {
         return;
     }
 
-    // Only handle key press events (ignore key releases)
-    if (scancode & 0x80) {
-        return;
+    update_modifiers(keycode, pressed);
+    queue_event(keycode, pressed, timestamp);
+}
+
+// Bottom half: decode everything the handler has queued
+static void keyboard_decode(void* ctx) {
+    (void)ctx;  // Unused parameter
+
+    uint32_t head = scancode_head;
+    uint32_t tail = load_acquire(&scancode_tail);
+    for (; head != tail; head++) {
+        const struct raw_scancode* raw = &scancode_ring[head & (SCANCODE_RING_SIZE - 1)];
+        decode_scancode(raw->code, raw->timestamp);
     }
+    store_release(&scancode_head, head);
+}
 
-    // Convert scancode to ASCII
-    if (scancode < sizeof(scancode_to_ascii)) {
-        char c;
-        if (shift_pressed) {
-            c = scancode_to_ascii_shift[scancode];
-        } else {
-            c = scancode_to_ascii[scancode];
+extern "C" {
+    bool keyboard_poll_event(struct key_event* event) {
+        uint32_t head = queue_head;
+        if (head == load_acquire(&queue_tail)) {
+            return false;
         }
+        *event = event_queue[head & (KEYBOARD_BUFFER_SIZE - 1)];
+        store_release(&queue_head, head + 1);
+        return true;
+    }
 
-        // Apply caps lock
-        if (caps_lock && ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))) {
-            c ^= 0x20;  // Toggle case
+    void keyboard_wait(struct key_event* event) {
+        // Check with interrupts off so an event queued just before the
+        // hlt is not left waiting for the next interrupt
+        irq_disable();
+        while (!keyboard_poll_event(event)) {
+            cpu_idle();
+            irq_disable();
         }
+        irq_enable();
+    }
 
-        // Add to buffer if it's a printable character
-        if (c) {
-            int next_end = (buffer_end + 1) % KEYBOARD_BUFFER_SIZE;
-            if (next_end != buffer_start) {  // Buffer not full
-                keyboard_buffer[buffer_end] = c;
-                buffer_end = next_end;
-            }
+    char keyboard_event_char(const struct key_event* event) {
+        if (!event->pressed || event->keycode >= 0x80) {
+            return 0;
         }
+        char c = (char)event->keycode;
+        if ((event->modifiers & KEYMOD_CTRL) && ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))) {
+            return c & 0x1F;
+        }
+        return c;
     }
-}
 
-extern "C" {
     char keyboard_getchar() {
-        if (buffer_start == buffer_end) {
-            return 0; // No character available
+        struct key_event event;
+        while (keyboard_poll_event(&event)) {
+            char c = keyboard_event_char(&event);
+            if (c) {
+                return c;
+            }
         }
-        char c = keyboard_buffer[buffer_start];
-        buffer_start = (buffer_start + 1) % KEYBOARD_BUFFER_SIZE;
-        return c;
+        return 0; // No character available
     }
 }
 
 bool keyboard_available() {
-    return buffer_start != buffer_end;
+    return queue_head != load_acquire(&queue_tail);
 }
 
 void keyboard_clear_buffer() {
-    buffer_start = buffer_end = 0;
+    store_release(&queue_head, load_acquire(&queue_tail));
 }
@@ -5,10 +5,10 @@
 #include <stdbool.h>
 #include "interrupts.h"
 
-// Buffer size
+// Event queue size, a power of two
 #define KEYBOARD_BUFFER_SIZE 256
 
-// Special keys
+// Set 1 scancodes of special keys
 #define KEY_ESC       0x01
 #define KEY_BACKSPACE 0x0E
 #define KEY_TAB       0x0F
@@ -30,13 +30,62 @@
 #define KEY_PGDN      0x51
 #define KEY_DEL       0x53
 
+// Key codes carried by events. Keys that type a character use its
+// ASCII value with Shift and Caps Lock applied (Enter is '\n',
+// Backspace '\b', Escape 0x1B); the rest use the codes below.
+#define KEYCODE_F1        0x100   // F1..F12 are consecutive
+#define KEYCODE_F12       0x10B
+#define KEYCODE_UP        0x110
+#define KEYCODE_DOWN      0x111
+#define KEYCODE_LEFT      0x112
+#define KEYCODE_RIGHT     0x113
+#define KEYCODE_HOME      0x114
+#define KEYCODE_END       0x115
+#define KEYCODE_PGUP      0x116
+#define KEYCODE_PGDN      0x117
+#define KEYCODE_INSERT    0x118
+#define KEYCODE_DELETE    0x119
+#define KEYCODE_LSHIFT    0x120
+#define KEYCODE_RSHIFT    0x121
+#define KEYCODE_LCTRL     0x122
+#define KEYCODE_RCTRL     0x123
+#define KEYCODE_LALT      0x124
+#define KEYCODE_RALT      0x125
+#define KEYCODE_CAPS_LOCK 0x126
+#define KEYCODE_NUM_LOCK  0x127
+#define KEYCODE_SCROLL_LOCK 0x128
+
+// Modifier bits
+#define KEYMOD_SHIFT 0x01
+#define KEYMOD_CTRL  0x02
+#define KEYMOD_ALT   0x04
+#define KEYMOD_CAPS  0x08
+
+struct key_event {
+    uint16_t keycode;
+    uint8_t modifiers;      // State after this event
+    bool pressed;           // false for a release
+    uint64_t timestamp;     // clock_ns() when the scancode arrived
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 // Function declarations
 void keyboard_init(void);
-void keyboard_handler(struct registers* regs);
+
+// Next queued event; false if the queue is empty
+bool keyboard_poll_event(struct key_event* event);
+
+// Sleep until an event is queued, then take it
+void keyboard_wait(struct key_event* event);
+
+// Character typed by a key press, with Ctrl+letter giving its control
+// code; 0 for releases and keys that type nothing
+char keyboard_event_char(const struct key_event* event);
+
+// Next typed character, skipping other events; 0 if none
 char keyboard_getchar(void);
 bool keyboard_available(void);
 void keyboard_clear_buffer(void);
@@ -0,0 +1,145 @@
+#include "klog.h"
+#include "kernel.h"
+#include "serial.h"
+#include "stdio.h"
+#include "clock.h"
+
+static_assert((KLOG_RECORDS & (KLOG_RECORDS - 1)) == 0, "KLOG_RECORDS must be a power of two");
+
+// Fixed-size records in a ring indexed by a free-running sequence
+// number. A writer claims a sequence with an atomic add, so interrupt
+// handlers can log while other code is mid-record, then publishes the
+// record by storing its sequence + 1 in commit. Writers never wait:
+// when the ring is full the oldest record is overwritten. The reader
+// checks commit before and after copying a record to detect that.
+struct klog_record {
+    uint32_t commit;        // Sequence + 1 once written, 0 while in progress
+    uint8_t level;
+    uint16_t length;
+    uint64_t timestamp;     // clock_ns() when logged
+    char text[KLOG_TEXT_MAX];
+};
+
+static struct klog_record records[KLOG_RECORDS];
+static uint32_t klog_head = 0;      // Next sequence to claim
+static uint32_t klog_tail = 0;      // Next sequence to flush
+static uint32_t dropped = 0;
+
+static const char* const level_tags[] = { "error: ", "warning: ", "", "debug: " };
+
+static inline uint32_t load_acquire(const uint32_t* p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void store_release(uint32_t* p, uint32_t v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+void vklog(int level, const char* format, va_list ap) {
+    uint32_t seq = __atomic_fetch_add(&klog_head, 1, __ATOMIC_RELAXED);
+    struct klog_record* r = &records[seq & (KLOG_RECORDS - 1)];
+
+    __atomic_store_n(&r->commit, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    // Records are lines; the flush adds the newline
+    int length = vsnprintf(r->text, sizeof(r->text), format, ap);
+    if (length > (int)sizeof(r->text) - 1) {
+        length = sizeof(r->text) - 1;
+    }
+    if (length > 0 && r->text[length - 1] == '\n') {
+        r->text[--length] = '\0';
+    }
+    r->length = length > 0 ? length : 0;
+    r->level = level < KLOG_ERR ? KLOG_ERR : level > KLOG_DEBUG ? KLOG_DEBUG : level;
+    r->timestamp = clock_ns();
+    store_release(&r->commit, seq + 1);
+}
+
+void klog(int level, const char* format, ...) {
+    va_list ap;
+    va_start(ap, format);
+    vklog(level, format, ap);
+    va_end(ap);
+}
+
+// Copy out the record for seq. Returns false if it is not committed
+// yet or was overwritten while being read.
+static bool read_record(uint32_t seq, struct klog_record* out) {
+    const struct klog_record* r = &records[seq & (KLOG_RECORDS - 1)];
+    if (load_acquire(&r->commit) != seq + 1) {
+        return false;
+    }
+    *out = *r;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&r->commit, __ATOMIC_RELAXED) == seq + 1;
+}
+
+// Timestamps print as seconds and microseconds since boot
+static void format_record(const struct klog_record* r, char* line, size_t size) {
+    uint32_t ns;
+    uint32_t seconds = (uint32_t)clock_div_u64(r->timestamp, 1000000000u, &ns);
+    uint32_t us = ns / 1000;
+
+    // vsnprintf has no field widths, so zero-pad by hand
+    char fraction[7];
+    for (int i = 5; i >= 0; i--) {
+        fraction[i] = '0' + us % 10;
+        us /= 10;
+    }
+    fraction[6] = '\0';
+
+    snprintf(line, size, "[%u.%s] %s%s\n", (unsigned)seconds, fraction,
+             level_tags[r->level], r->text);
+}
+
+void klog_flush() {
+    char line[KLOG_TEXT_MAX + 48];
+    struct klog_record r;
+
+    for (;;) {
+        uint32_t head = load_acquire(&klog_head);
+        uint32_t tail = klog_tail;
+        if (head - tail > KLOG_RECORDS) {
+            dropped += head - tail - KLOG_RECORDS;
+            tail = head - KLOG_RECORDS;
+            klog_tail = tail;
+        }
+        if (tail == head) {
+            break;
+        }
+        if (!read_record(tail, &r)) {
+            // Still being written, or lapped since head was read
+            if (load_acquire(&klog_head) - tail > KLOG_RECORDS) {
+                continue;
+            }
+            break;
+        }
+        klog_tail = tail + 1;
+
+        format_record(&r, line, sizeof(line));
+        if (r.level <= KLOG_CONSOLE_LEVEL) {
+            terminal_write_string(line);  // Mirrored to serial
+        } else {
+            serial_write_string(line);
+        }
+    }
+}
+
+void klog_dump(void (*print)(const char* line)) {
+    char line[KLOG_TEXT_MAX + 48];
+    struct klog_record r;
+
+    uint32_t head = load_acquire(&klog_head);
+    uint32_t seq = head - (head < KLOG_RECORDS ? head : KLOG_RECORDS);
+    for (; seq != head; seq++) {
+        if (read_record(seq, &r)) {
+            format_record(&r, line, sizeof(line));
+            print(line);
+        }
+    }
+}
+
+uint32_t klog_dropped() {
+    return dropped;
+}
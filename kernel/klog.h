@@ -0,0 +1,49 @@
+#ifndef KLOG_H
+#define KLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdarg.h>
+
+// Log levels, most severe first
+#define KLOG_ERR   0
+#define KLOG_WARN  1
+#define KLOG_INFO  2
+#define KLOG_DEBUG 3
+
+// Records at this level or more severe are also drawn on the terminal;
+// every record goes to the serial port
+#ifndef KLOG_CONSOLE_LEVEL
+#define KLOG_CONSOLE_LEVEL KLOG_WARN
+#endif
+
+// Ring size in records (a power of two) and longest message kept
+#ifndef KLOG_RECORDS
+#define KLOG_RECORDS 512
+#endif
+#define KLOG_TEXT_MAX 112
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Format a message into the log ring. Safe from interrupt handlers:
+// it never blocks and never touches the console.
+void klog(int level, const char* format, ...);
+void vklog(int level, const char* format, va_list ap);
+
+// Write out records logged since the last flush. Called from the idle
+// loop; not reentrant and not for interrupt context.
+void klog_flush(void);
+
+// Print every record still held in the ring, oldest first
+void klog_dump(void (*print)(const char* line));
+
+// Records overwritten before they could be flushed
+uint32_t klog_dropped(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KLOG_H
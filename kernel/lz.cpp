@@ -0,0 +1,221 @@
+#include "lz.h"
+#include "string.h"
+
+// LZ4 block format: each sequence is a token (literal length in the high
+// nibble, match length - 4 in the low nibble), optional length extension
+// bytes, the literals, a 16-bit little-endian offset and optional match
+// length extension bytes. The final sequence carries literals only.
+#define LZ_MIN_MATCH     4
+#define LZ_LAST_LITERALS 5
+#define LZ_MFLIMIT       12
+#define LZ_MAX_OFFSET    65535
+#define LZ_HASH_LOG      12
+#define LZ_HASH_SIZE     (1 << LZ_HASH_LOG)
+#define LZ_SKIP_TRIGGER  6
+
+// Positions of recently seen 4-byte sequences, relative to the block start
+static uint16_t hash_table[LZ_HASH_SIZE];
+
+static inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    __builtin_memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t hash32(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ_HASH_LOG);
+}
+
+// Copy n bytes four at a time. Safe for overlapping matches as long as
+// the source trails the destination by at least four bytes.
+static inline void copy_wide(uint8_t* dst, const uint8_t* src, size_t n) {
+    while (n >= 4) {
+        uint32_t v = read32(src);
+        __builtin_memcpy(dst, &v, sizeof(v));
+        dst += 4;
+        src += 4;
+        n -= 4;
+    }
+    while (n--) *dst++ = *src++;
+}
+
+static uint8_t* write_length(uint8_t* op, size_t length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (uint8_t)length;
+    return op;
+}
+
+// Emit one sequence, or the trailing literals when match_length is 0.
+// Returns nullptr if the output would overflow.
+static uint8_t* write_sequence(uint8_t* op, uint8_t* oend,
+                               const uint8_t* literals, size_t literal_length,
+                               size_t offset, size_t match_length) {
+    size_t needed = 1 + literal_length + literal_length / 255 + 1;
+    if (match_length) {
+        needed += 2 + match_length / 255 + 1;
+    }
+    if ((size_t)(oend - op) < needed) {
+        return nullptr;
+    }
+
+    uint8_t* token = op++;
+    size_t match_code = match_length ? match_length - LZ_MIN_MATCH : 0;
+
+    *token = (uint8_t)((literal_length < 15 ? literal_length : 15) << 4);
+    if (literal_length >= 15) {
+        op = write_length(op, literal_length - 15);
+    }
+    copy_wide(op, literals, literal_length);
+    op += literal_length;
+
+    if (match_length) {
+        *op++ = (uint8_t)(offset & 0xFF);
+        *op++ = (uint8_t)(offset >> 8);
+        *token |= (uint8_t)(match_code < 15 ? match_code : 15);
+        if (match_code >= 15) {
+            op = write_length(op, match_code - 15);
+        }
+    }
+    return op;
+}
+
+extern "C" size_t lz_compress(const uint8_t* src, size_t src_size,
+                              uint8_t* dst, size_t dst_capacity) {
+    if (!src || !dst || src_size > LZ_MAX_INPUT) {
+        return 0;
+    }
+
+    const uint8_t* ip = src;
+    const uint8_t* anchor = src;
+    const uint8_t* const end = src + src_size;
+    uint8_t* op = dst;
+    uint8_t* const oend = dst + dst_capacity;
+
+    if (src_size > LZ_MFLIMIT) {
+        const uint8_t* const match_limit = end - LZ_MFLIMIT;
+        const uint8_t* const extend_limit = end - LZ_LAST_LITERALS;
+        unsigned misses = 1 << LZ_SKIP_TRIGGER;
+
+        memset(hash_table, 0, sizeof(hash_table));
+        hash_table[hash32(read32(ip))] = 0;
+        ip++;
+
+        while (ip < match_limit) {
+            uint32_t sequence = read32(ip);
+            uint32_t h = hash32(sequence);
+            const uint8_t* ref = src + hash_table[h];
+            hash_table[h] = (uint16_t)(ip - src);
+
+            if (ref >= ip || (size_t)(ip - ref) > LZ_MAX_OFFSET || read32(ref) != sequence) {
+                // Step faster through data that keeps missing
+                ip += misses++ >> LZ_SKIP_TRIGGER;
+                continue;
+            }
+            misses = 1 << LZ_SKIP_TRIGGER;
+
+            // Extend backwards over pending literals, then forwards
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+            const uint8_t* mp = ip + LZ_MIN_MATCH;
+            const uint8_t* rp = ref + LZ_MIN_MATCH;
+            while (mp < extend_limit && *mp == *rp) {
+                mp++;
+                rp++;
+            }
+
+            op = write_sequence(op, oend, anchor, ip - anchor, ip - ref, mp - ip);
+            if (!op) {
+                return 0;
+            }
+
+            ip = mp;
+            anchor = ip;
+            if (ip < match_limit) {
+                hash_table[hash32(read32(ip - 2))] = (uint16_t)(ip - 2 - src);
+            }
+        }
+    }
+
+    op = write_sequence(op, oend, anchor, end - anchor, 0, 0);
+    if (!op) {
+        return 0;
+    }
+    return op - dst;
+}
+
+extern "C" int lz_decompress(const uint8_t* src, size_t src_size,
+                             uint8_t* dst, size_t dst_capacity) {
+    if (!src || !dst) {
+        return -1;
+    }
+
+    const uint8_t* ip = src;
+    const uint8_t* const iend = src + src_size;
+    uint8_t* op = dst;
+    uint8_t* const oend = dst + dst_capacity;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+
+        // Literals
+        size_t length = token >> 4;
+        if (length == 15) {
+            uint8_t b;
+            do {
+                if (ip >= iend) return -1;
+                b = *ip++;
+                length += b;
+            } while (b == 255);
+        }
+        if ((size_t)(iend - ip) < length || (size_t)(oend - op) < length) {
+            return -1;
+        }
+        copy_wide(op, ip, length);
+        op += length;
+        ip += length;
+
+        // The last sequence ends after its literals
+        if (ip == iend) {
+            break;
+        }
+
+        // Match
+        if (iend - ip < 2) {
+            return -1;
+        }
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dst)) {
+            return -1;
+        }
+
+        length = token & 0x0F;
+        if (length == 15) {
+            uint8_t b;
+            do {
+                if (ip >= iend) return -1;
+                b = *ip++;
+                length += b;
+            } while (b == 255);
+        }
+        length += LZ_MIN_MATCH;
+        if ((size_t)(oend - op) < length) {
+            return -1;
+        }
+
+        const uint8_t* match = op - offset;
+        if (offset >= 4) {
+            copy_wide(op, match, length);
+            op += length;
+        } else {
+            while (length--) *op++ = *match++;
+        }
+    }
+
+    return (int)(op - dst);
+}
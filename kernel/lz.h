@@ -0,0 +1,29 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Largest block the codec accepts (match positions are kept in 16 bits)
+#define LZ_MAX_INPUT 65536
+
+// Worst-case compressed size for an incompressible block of n bytes
+#define LZ_COMPRESS_BOUND(n) ((n) + ((n) / 255) + 16)
+
+// Compress one block in LZ4 block format. Returns the compressed size,
+// or 0 if the output did not fit in dst_capacity.
+size_t lz_compress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_capacity);
+
+// Decompress one block. Returns the decompressed size, or -1 if the
+// input is malformed or would overflow dst_capacity.
+int lz_decompress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LZ_H
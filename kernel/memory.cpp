@@ -2,68 +2,67 @@
 #include <stddef.h>
 #include <stdint.h>
 
-// Simple memory allocator implementation
-#define HEAP_START 0x100000
-#define HEAP_SIZE  0x100000
+// Simple memory allocator implementation. The heap starts right after the
+// kernel image; the linker script provides _kernel_end.
+#define HEAP_SIZE  0x400000
+#define HEAP_ALIGN 16
+
+extern "C" char _kernel_end[];
 
 struct block_meta {
     size_t size;
     struct block_meta* next;
     bool is_free;
-};
+} __attribute__((aligned(HEAP_ALIGN)));
 
 static struct block_meta* heap_start = nullptr;
 
 void memory_init() {
-    // Initialize the heap
-    heap_start = (struct block_meta*)HEAP_START;
+    // Initialize the heap as one free block
+    uintptr_t base = ((uintptr_t)_kernel_end + HEAP_ALIGN - 1) & ~(uintptr_t)(HEAP_ALIGN - 1);
+    heap_start = (struct block_meta*)base;
     heap_start->size = HEAP_SIZE - sizeof(struct block_meta);
     heap_start->next = nullptr;
     heap_start->is_free = true;
 }
 
-static struct block_meta* find_free_block(struct block_meta** last, size_t size) {
+static struct block_meta* find_free_block(size_t size) {
     struct block_meta* current = heap_start;
     while (current && !(current->is_free && current->size >= size)) {
-        *last = current;
         current = current->next;
     }
     return current;
 }
 
-static struct block_meta* request_space(struct block_meta* last, size_t size) {
-    struct block_meta* block;
-    block = last->next = (struct block_meta*)((char*)last + sizeof(struct block_meta) + last->size);
+// Carve the tail of a free block off into a new free block
+static void split_block(struct block_meta* block, size_t size) {
+    if (block->size < size + sizeof(struct block_meta) + HEAP_ALIGN) {
+        return;
+    }
+    struct block_meta* rest = (struct block_meta*)((char*)(block + 1) + size);
+    rest->size = block->size - size - sizeof(struct block_meta);
+    rest->next = block->next;
+    rest->is_free = true;
     block->size = size;
-    block->next = nullptr;
-    block->is_free = false;
-    return block;
+    block->next = rest;
 }
 
 extern "C" void* malloc(size_t size) {
     if (size == 0) return nullptr;
     
-    struct block_meta* block;
-    
     // First call to malloc
     if (heap_start == nullptr) {
         memory_init();
     }
     
-    struct block_meta* last = heap_start;
-    block = find_free_block(&last, size);
-    
+    size = (size + HEAP_ALIGN - 1) & ~(size_t)(HEAP_ALIGN - 1);
+    struct block_meta* block = find_free_block(size);
     if (block == nullptr) {
-        // No free block found - allocate new one
-        block = request_space(last, size);
-        if (block == nullptr) {
-            return nullptr;
-        }
-    } else {
-        // Found free block
-        block->is_free = false;
+        return nullptr;  // Heap exhausted
     }
-    
+
+    split_block(block, size);
+    block->is_free = false;
     return (void*)(block + 1);
 }
 
@@ -110,13 +109,42 @@ extern "C" void* realloc(void* ptr, size_t size) {
     return new_ptr;
 }
 
+// Whole dwords with rep movsd, then the tail bytes
 extern "C" void* memcpy(void* dest, const void* src, size_t n) {
-    char* d = (char*)dest;
-    const char* s = (const char*)src;
-    while (n--) *d++ = *s++;
+    void* d = dest;
+    size_t dwords = n >> 2;
+    size_t bytes = n & 3;
+    asm volatile("rep movsl" : "+D"(d), "+S"(src), "+c"(dwords) : : "memory");
+    asm volatile("rep movsb" : "+D"(d), "+S"(src), "+c"(bytes) : : "memory");
     return dest;
 }
 
+// One bit per frame in the page pool, set while allocated
+static uint32_t page_bitmap[PAGE_POOL_FRAMES / 32];
+static size_t page_hint = 0;
+
+extern "C" void* page_alloc() {
+    for (size_t n = 0; n < PAGE_POOL_FRAMES / 32; n++) {
+        size_t word = (page_hint + n) % (PAGE_POOL_FRAMES / 32);
+        if (page_bitmap[word] == 0xFFFFFFFF) {
+            continue;
+        }
+        uint32_t bit = __builtin_ctz(~page_bitmap[word]);
+        page_bitmap[word] |= 1u << bit;
+        page_hint = word;
+        return (void*)(PAGE_POOL_START + (word * 32 + bit) * PAGE_SIZE);
+    }
+    return nullptr;  // Pool exhausted
+}
+
+extern "C" void page_free(void* page) {
+    if (page == nullptr) return;
+
+    size_t frame = ((uintptr_t)page - PAGE_POOL_START) / PAGE_SIZE;
+    if (frame >= PAGE_POOL_FRAMES) return;
+    page_bitmap[frame / 32] &= ~(1u << (frame % 32));
+}
+
 size_t memory_get_total() {
     // TODO: Implement actual memory detection
     return 64 * 1024 * 1024; // Return 64MB for now
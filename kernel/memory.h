@@ -23,6 +23,16 @@ void free(void* ptr);
 void* realloc(void* ptr, size_t size);
 void* memcpy(void* dest, const void* src, size_t n);
 
+// Page frame allocator. Frames come from a pool above the heap that is
+// identity mapped, so the returned address is also the physical address.
+// Frames are not zeroed.
+#define PAGE_SIZE 4096
+#define PAGE_POOL_START 0x1000000
+#define PAGE_POOL_FRAMES 4096
+
+void* page_alloc(void);
+void page_free(void* page);
+
 // Memory block structure
 struct memory_block {
     size_t size;
@@ -0,0 +1,88 @@
+#include "mmap.h"
+#include "filesystem.h"
+#include "paging.h"
+#include "memory.h"
+
+#define MMAP_SLOT_SIZE MAX_FILE_SIZE
+
+struct mapping {
+    struct File* file;
+    size_t first_block;
+    size_t pages;
+    bool used;
+};
+
+static struct mapping mappings[MMAP_SLOTS];
+
+static uintptr_t slot_base(size_t slot) {
+    return MMAP_BASE + slot * MMAP_SLOT_SIZE;
+}
+
+extern "C" const void* file_mmap(const char* filename, size_t offset, size_t length) {
+    struct File* file = file_lookup(filename);
+    if (!file || offset >= file->size) {
+        return nullptr;
+    }
+    if (length == 0 || length > file->size - offset) {
+        length = file->size - offset;
+    }
+
+    for (size_t slot = 0; slot < MMAP_SLOTS; slot++) {
+        if (mappings[slot].used) {
+            continue;
+        }
+        size_t first_block = offset / FS_BLOCK_SIZE;
+        size_t last_block = (offset + length - 1) / FS_BLOCK_SIZE;
+
+        mappings[slot].file = file;
+        mappings[slot].first_block = first_block;
+        mappings[slot].pages = last_block - first_block + 1;
+        mappings[slot].used = true;
+        file_pin(file);
+
+        return (const void*)(slot_base(slot) + offset % FS_BLOCK_SIZE);
+    }
+    return nullptr;  // No free mapping slots
+}
+
+extern "C" int file_munmap(const void* addr) {
+    uintptr_t address = (uintptr_t)addr;
+    if (address < MMAP_BASE || address >= slot_base(MMAP_SLOTS)) {
+        return -1;
+    }
+
+    size_t slot = (address - MMAP_BASE) / MMAP_SLOT_SIZE;
+    struct mapping* map = &mappings[slot];
+    if (!map->used) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < map->pages; i++) {
+        paging_unmap_page(slot_base(slot) + i * PAGE_SIZE);
+    }
+    file_unpin(map->file);
+    map->used = false;
+    return 0;
+}
+
+extern "C" bool mmap_handle_fault(uintptr_t address, uint32_t error_code) {
+    if (address < MMAP_BASE || address >= slot_base(MMAP_SLOTS)) {
+        return false;
+    }
+    if (error_code & (PAGE_FAULT_PRESENT | PAGE_FAULT_WRITE)) {
+        return false;  // Mappings are read-only
+    }
+
+    size_t slot = (address - MMAP_BASE) / MMAP_SLOT_SIZE;
+    size_t page = (address - slot_base(slot)) / PAGE_SIZE;
+    struct mapping* map = &mappings[slot];
+    if (!map->used || page >= map->pages) {
+        return false;
+    }
+
+    void* frame = file_block_page(map->file, map->first_block + page);
+    if (!frame) {
+        return false;
+    }
+    return paging_map_page(slot_base(slot) + page * PAGE_SIZE, (uintptr_t)frame, 0) == 0;
+}
@@ -0,0 +1,31 @@
+#ifndef MMAP_H
+#define MMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Virtual window file mappings are placed in; each mapping gets a slot
+// large enough for the biggest file
+#define MMAP_BASE  0xD0000000
+#define MMAP_SLOTS 64
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Map length bytes of a file starting at offset, read-only. Pages are
+// populated on first touch and share storage with the filesystem. A
+// length of 0 maps to the end of the file. Returns nullptr on failure.
+const void* file_mmap(const char* filename, size_t offset, size_t length);
+int file_munmap(const void* addr);
+
+// Called from the page fault handler; returns false if the fault is not
+// a read of a mapped file page
+bool mmap_handle_fault(uintptr_t address, uint32_t error_code);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MMAP_H
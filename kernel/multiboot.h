@@ -100,7 +100,6 @@ struct multiboot_vbe_mode_info {
 
 /* Multiboot information structure */
 struct multiboot_info {
-    uint32_t magic;
     uint32_t flags;
     uint32_t mem_lower;
     uint32_t mem_upper;
@@ -161,6 +160,11 @@ struct multiboot_info {
     } framebuffer;
 };
 
+/* Framebuffer types */
+#define MULTIBOOT_FRAMEBUFFER_TYPE_INDEXED 0
+#define MULTIBOOT_FRAMEBUFFER_TYPE_RGB 1
+#define MULTIBOOT_FRAMEBUFFER_TYPE_EGA_TEXT 2
+
 typedef struct multiboot_info multiboot_info_t;
 
 /* Module structure */
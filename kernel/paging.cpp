@@ -0,0 +1,88 @@
+#include "paging.h"
+#include "memory.h"
+#include "kernel.h"
+#include "mmap.h"
+#include "string.h"
+
+#define PAGE_TABLE_ENTRIES 1024
+#define PAGE_TABLE_SPAN    (PAGE_SIZE * PAGE_TABLE_ENTRIES)
+#define IDENTITY_TABLES    (PAGING_IDENTITY_LIMIT / PAGE_TABLE_SPAN)
+
+#define CR0_WRITE_PROTECT 0x00010000
+#define CR0_PAGING        0x80000000
+
+static uint32_t page_directory[PAGE_TABLE_ENTRIES] __attribute__((aligned(PAGE_SIZE)));
+static uint32_t identity_tables[IDENTITY_TABLES][PAGE_TABLE_ENTRIES] __attribute__((aligned(PAGE_SIZE)));
+
+static void page_fault_handler(struct registers* regs, void* ctx);
+
+static inline void invlpg(uintptr_t virt) {
+    asm volatile("invlpg (%0)" : : "r"(virt) : "memory");
+}
+
+void paging_init() {
+    // Identity map low memory
+    for (size_t t = 0; t < IDENTITY_TABLES; t++) {
+        for (size_t i = 0; i < PAGE_TABLE_ENTRIES; i++) {
+            uintptr_t phys = t * PAGE_TABLE_SPAN + i * PAGE_SIZE;
+            identity_tables[t][i] = phys | PAGE_PRESENT | PAGE_WRITABLE;
+        }
+        page_directory[t] = (uintptr_t)identity_tables[t] | PAGE_PRESENT | PAGE_WRITABLE;
+    }
+
+    // Load the directory and turn paging on. WP makes read-only mappings
+    // fault on kernel writes too.
+    asm volatile("mov %0, %%cr3" : : "r"(page_directory) : "memory");
+    uint32_t cr0;
+    asm volatile("mov %%cr0, %0" : "=r"(cr0));
+    cr0 |= CR0_PAGING | CR0_WRITE_PROTECT;
+    asm volatile("mov %0, %%cr0" : : "r"(cr0) : "memory");
+
+    register_interrupt_handler(VECTOR_PAGE_FAULT, page_fault_handler, nullptr);
+}
+
+int paging_map_page(uintptr_t virt, uintptr_t phys, uint32_t flags) {
+    size_t dir_index = virt / PAGE_TABLE_SPAN;
+    size_t table_index = (virt / PAGE_SIZE) % PAGE_TABLE_ENTRIES;
+
+    if (!(page_directory[dir_index] & PAGE_PRESENT)) {
+        uint32_t* table = (uint32_t*)page_alloc();
+        if (!table) {
+            return -1;
+        }
+        memset(table, 0, PAGE_SIZE);
+        page_directory[dir_index] = (uintptr_t)table | PAGE_PRESENT | PAGE_WRITABLE;
+    }
+
+    uint32_t* table = (uint32_t*)(page_directory[dir_index] & ~(PAGE_SIZE - 1));
+    table[table_index] = (phys & ~(PAGE_SIZE - 1)) | flags | PAGE_PRESENT;
+    invlpg(virt);
+    return 0;
+}
+
+void paging_unmap_page(uintptr_t virt) {
+    size_t dir_index = virt / PAGE_TABLE_SPAN;
+    size_t table_index = (virt / PAGE_SIZE) % PAGE_TABLE_ENTRIES;
+
+    if (!(page_directory[dir_index] & PAGE_PRESENT)) {
+        return;
+    }
+    uint32_t* table = (uint32_t*)(page_directory[dir_index] & ~(PAGE_SIZE - 1));
+    table[table_index] = 0;
+    invlpg(virt);
+}
+
+static void page_fault_handler(struct registers* regs, void* ctx) {
+    (void)ctx;  // Unused parameter
+
+    uintptr_t address;
+    asm volatile("mov %%cr2, %0" : "=r"(address));
+
+    if (mmap_handle_fault(address, regs->err_code)) {
+        return;
+    }
+
+    char message[48];
+    snprintf(message, sizeof(message), "page fault at 0x%x", (unsigned)address);
+    kernel_panic(message);
+}
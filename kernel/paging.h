@@ -0,0 +1,34 @@
+#ifndef PAGING_H
+#define PAGING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "interrupts.h"
+
+// Page table entry flags
+#define PAGE_PRESENT        0x001
+#define PAGE_WRITABLE       0x002
+#define PAGE_WRITE_THROUGH  0x008
+#define PAGE_CACHE_DISABLE  0x010
+
+// Page fault error code bits
+#define PAGE_FAULT_PRESENT  0x1
+#define PAGE_FAULT_WRITE    0x2
+
+// Low memory identity mapped at boot (kernel, heap and page pool)
+#define PAGING_IDENTITY_LIMIT 0x2000000
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void paging_init(void);
+int paging_map_page(uintptr_t virt, uintptr_t phys, uint32_t flags);
+void paging_unmap_page(uintptr_t virt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PAGING_H
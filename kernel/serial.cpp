@@ -0,0 +1,214 @@
+#include "serial.h"
+#include "io.h"
+#include "interrupts.h"
+
+// 16550 UART registers, relative to the port base
+#define UART_DATA        0
+#define UART_INT_ENABLE  1
+#define UART_DIVISOR_LO  0
+#define UART_DIVISOR_HI  1
+#define UART_INT_ID      2
+#define UART_FIFO_CTRL   2
+#define UART_LINE_CTRL   3
+#define UART_MODEM_CTRL  4
+#define UART_LINE_STATUS 5
+#define UART_MODEM_STATUS 6
+
+#define UART_IER_RX_DATA   0x01
+#define UART_IER_THR_EMPTY 0x02
+#define UART_IER_LINE      0x04
+
+#define UART_IIR_NONE      0x01
+#define UART_IIR_ID_MASK   0x0E
+#define UART_IIR_MODEM     0x00
+#define UART_IIR_THR_EMPTY 0x02
+#define UART_IIR_RX_DATA   0x04
+#define UART_IIR_LINE      0x06
+#define UART_IIR_RX_TIMEOUT 0x0C
+#define UART_IIR_FIFO      0xC0
+
+#define UART_LSR_DATA_READY 0x01
+#define UART_LSR_THR_EMPTY  0x20
+
+#define UART_FIFO_DEPTH 16
+
+static_assert((SERIAL_TX_BUFFER_SIZE & (SERIAL_TX_BUFFER_SIZE - 1)) == 0, "TX ring size must be a power of two");
+static_assert((SERIAL_RX_BUFFER_SIZE & (SERIAL_RX_BUFFER_SIZE - 1)) == 0, "RX ring size must be a power of two");
+
+// Single-producer, single-consumer rings indexed by free-running
+// counters. Kernel code produces TX bytes and the interrupt handler
+// consumes them; RX runs the other way. Each side only writes its own
+// counter, so neither needs a lock.
+static char tx_ring[SERIAL_TX_BUFFER_SIZE];
+static uint32_t tx_head = 0;    // Next byte to send (handler)
+static uint32_t tx_tail = 0;    // Next free slot (kernel)
+static char rx_ring[SERIAL_RX_BUFFER_SIZE];
+static uint32_t rx_head = 0;    // Next byte to read (kernel)
+static uint32_t rx_tail = 0;    // Next free slot (handler)
+
+// Set while the THR-empty interrupt is armed. Changed by the handler,
+// or by kernel code with interrupts off.
+static volatile bool tx_running = false;
+static unsigned tx_fifo_depth = 1;
+
+static inline uint32_t load_acquire(const uint32_t* p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void store_release(uint32_t* p, uint32_t v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+static void serial_handler(struct registers* regs, void* ctx);
+
+void serial_init() {
+    outb(COM1_PORT + UART_INT_ENABLE, 0x00);   // No interrupts yet
+    outb(COM1_PORT + UART_LINE_CTRL, 0x80);    // DLAB on
+    outb(COM1_PORT + UART_DIVISOR_LO, 0x01);   // 115200 baud
+    outb(COM1_PORT + UART_DIVISOR_HI, 0x00);
+    outb(COM1_PORT + UART_LINE_CTRL, 0x03);    // 8N1, DLAB off
+    outb(COM1_PORT + UART_FIFO_CTRL, 0xC7);    // Enable and clear FIFOs, 14-byte RX trigger
+    outb(COM1_PORT + UART_MODEM_CTRL, 0x0B);   // DTR, RTS, OUT2 (routes the IRQ)
+
+    // An 8250 or 16450 has no FIFO and takes one byte per interrupt
+    if ((inb(COM1_PORT + UART_INT_ID) & UART_IIR_FIFO) == UART_IIR_FIFO) {
+        tx_fifo_depth = UART_FIFO_DEPTH;
+    }
+
+    tx_head = tx_tail = 0;
+    rx_head = rx_tail = 0;
+    tx_running = false;
+    register_interrupt_handler(IRQ_VECTOR(COM1_IRQ), serial_handler, nullptr);
+    outb(COM1_PORT + UART_INT_ENABLE, UART_IER_RX_DATA | UART_IER_LINE);
+}
+
+// Move up to one FIFO load from the TX ring to the UART. Returns false
+// once the ring is empty.
+static bool tx_fill_fifo() {
+    uint32_t head = tx_head;
+    uint32_t tail = load_acquire(&tx_tail);
+    for (unsigned i = 0; i < tx_fifo_depth && head != tail; i++) {
+        outb(COM1_PORT + UART_DATA, tx_ring[head & (SERIAL_TX_BUFFER_SIZE - 1)]);
+        head++;
+    }
+    store_release(&tx_head, head);
+    return head != tail;
+}
+
+static void rx_drain_fifo() {
+    while (inb(COM1_PORT + UART_LINE_STATUS) & UART_LSR_DATA_READY) {
+        char c = inb(COM1_PORT + UART_DATA);
+        uint32_t tail = rx_tail;
+        if (tail - load_acquire(&rx_head) == SERIAL_RX_BUFFER_SIZE) {
+            continue;  // Full: drop the byte
+        }
+        rx_ring[tail & (SERIAL_RX_BUFFER_SIZE - 1)] = c;
+        store_release(&rx_tail, tail + 1);
+    }
+}
+
+static void serial_handler(struct registers* regs, void* ctx) {
+    (void)regs;  // Unused parameters
+    (void)ctx;
+
+    uint8_t id;
+    while (!((id = inb(COM1_PORT + UART_INT_ID)) & UART_IIR_NONE)) {
+        switch (id & UART_IIR_ID_MASK) {
+            case UART_IIR_RX_DATA:
+            case UART_IIR_RX_TIMEOUT:
+                rx_drain_fifo();
+                break;
+            case UART_IIR_THR_EMPTY:
+                if (!tx_fill_fifo()) {
+                    outb(COM1_PORT + UART_INT_ENABLE, UART_IER_RX_DATA | UART_IER_LINE);
+                    tx_running = false;
+                }
+                break;
+            case UART_IIR_LINE:
+                inb(COM1_PORT + UART_LINE_STATUS);
+                break;
+            case UART_IIR_MODEM:
+                inb(COM1_PORT + UART_MODEM_STATUS);
+                break;
+        }
+    }
+}
+
+// Arm the THR-empty interrupt. The UART raises it straight away if the
+// transmitter is already idle.
+static void tx_start() {
+    uint32_t flags = irq_save();
+    if (!tx_running) {
+        tx_running = true;
+        outb(COM1_PORT + UART_INT_ENABLE, UART_IER_RX_DATA | UART_IER_THR_EMPTY | UART_IER_LINE);
+    }
+    irq_restore(flags);
+}
+
+void serial_flush() {
+    uint32_t flags = irq_save();
+    while (tx_head != tx_tail) {
+        while (!(inb(COM1_PORT + UART_LINE_STATUS) & UART_LSR_THR_EMPTY));
+        tx_fill_fifo();
+    }
+    irq_restore(flags);
+}
+
+static void tx_put(char c) {
+    uint32_t tail = tx_tail;
+    if (tail - load_acquire(&tx_head) == SERIAL_TX_BUFFER_SIZE) {
+        // Full: the line is the bottleneck, so wait for it directly
+        // rather than depend on interrupts being enabled
+        serial_flush();
+    }
+    tx_ring[tail & (SERIAL_TX_BUFFER_SIZE - 1)] = c;
+    store_release(&tx_tail, tail + 1);
+}
+
+void serial_write_char(char c) {
+    if (c == '\n') {
+        tx_put('\r');
+    }
+    tx_put(c);
+    if (!tx_running) {
+        tx_start();
+    }
+}
+
+void serial_write(const char* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (data[i] == '\n') {
+            tx_put('\r');
+        }
+        tx_put(data[i]);
+    }
+    if (!tx_running) {
+        tx_start();
+    }
+}
+
+void serial_write_string(const char* data) {
+    for (size_t i = 0; data[i] != '\0'; i++) {
+        if (data[i] == '\n') {
+            tx_put('\r');
+        }
+        tx_put(data[i]);
+    }
+    if (!tx_running) {
+        tx_start();
+    }
+}
+
+char serial_getchar() {
+    uint32_t head = rx_head;
+    if (head == load_acquire(&rx_tail)) {
+        return 0;
+    }
+    char c = rx_ring[head & (SERIAL_RX_BUFFER_SIZE - 1)];
+    store_release(&rx_head, head + 1);
+    return c;
+}
+
+bool serial_available() {
+    return rx_head != load_acquire(&rx_tail);
+}
@@ -0,0 +1,41 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define COM1_PORT 0x3F8
+#define COM1_IRQ  4
+
+// Ring sizes, powers of two
+#ifndef SERIAL_TX_BUFFER_SIZE
+#define SERIAL_TX_BUFFER_SIZE 8192
+#endif
+#ifndef SERIAL_RX_BUFFER_SIZE
+#define SERIAL_RX_BUFFER_SIZE 256
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void serial_init(void);
+
+// Output is queued and sent from the UART interrupt. Only one context
+// may write at a time; a full ring is drained by polling.
+void serial_write_char(char c);
+void serial_write(const char* data, size_t size);
+void serial_write_string(const char* data);
+
+// Send everything queued by polling, for use with interrupts disabled
+void serial_flush(void);
+
+// Next received byte, or 0 if none is waiting
+char serial_getchar(void);
+bool serial_available(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SERIAL_H
@@ -48,6 +48,22 @@ int vsnprintf(char* str, size_t size, const char* format, va_list ap) {
                     str[written++] = num[--len];
                 break;
             }
+            case 'u':
+            case 'x': {
+                unsigned value = va_arg(ap, unsigned);
+                unsigned base = (*ptr == 'x') ? 16 : 10;
+                char num[32];
+                int len = 0;
+                
+                do {
+                    num[len++] = "0123456789abcdef"[value % base];
+                    value /= base;
+                } while (value && len < 31);
+                
+                while (len > 0 && written < size - 1)
+                    str[written++] = num[--len];
+                break;
+            }
             default:
                 str[written++] = *ptr;
                 break;
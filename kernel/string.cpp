@@ -8,8 +8,12 @@ extern "C" {
     }
 
     void* memset(void* s, int c, size_t n) {
-        unsigned char* p = (unsigned char*)s;
-        while (n--) *p++ = (unsigned char)c;
+        void* d = s;
+        uint32_t fill = (uint8_t)c * 0x01010101u;
+        size_t dwords = n >> 2;
+        size_t bytes = n & 3;
+        asm volatile("rep stosl" : "+D"(d), "+c"(dwords) : "a"(fill) : "memory");
+        asm volatile("rep stosb" : "+D"(d), "+c"(bytes) : "a"(fill) : "memory");
         return s;
     }
 
@@ -19,12 +23,24 @@ extern "C" {
     void* memmove(void* dest, const void* src, size_t n) {
         unsigned char* d = (unsigned char*)dest;
         const unsigned char* s = (const unsigned char*)src;
-        if (d < s) {
-            while (n--) *d++ = *s++;
-        } else {
-            d += n;
-            s += n;
-            while (n--) *--d = *--s;
+        if (d <= s || d >= s + n) {
+            return memcpy(dest, src, n);  // Copies forwards
+        }
+
+        // Overlapping with dest above src: copy backwards a dword at a
+        // time, leaving the direction flag alone for interrupt handlers
+        d += n;
+        s += n;
+        while (n & 3) {
+            *--d = *--s;
+            n--;
+        }
+        uint32_t* dw = (uint32_t*)d;
+        const uint32_t* sw = (const uint32_t*)s;
+        for (n >>= 2; n; n--) {
+            uint32_t v;
+            __builtin_memcpy(&v, --sw, sizeof(v));
+            __builtin_memcpy(--dw, &v, sizeof(v));
         }
         return dest;
     }
@@ -0,0 +1,820 @@
+#include "kernel.h"
+#include "console.h"
+#include "string.h"
+#include "serial.h"
+
+// CRTC registers
+#define CRTC_INDEX_PORT   0x3D4
+#define CRTC_DATA_PORT    0x3D5
+#define CRTC_START_HIGH   0x0C
+#define CRTC_START_LOW    0x0D
+#define CRTC_CURSOR_HIGH  0x0E
+#define CRTC_CURSOR_LOW   0x0F
+
+// Text mode video memory is a 32 KiB window; the visible screen is a
+// VGA_HEIGHT-row view into it starting at the CRTC start address
+#define VGA_MEMORY_ROWS (0x8000 / (VGA_WIDTH * sizeof(uint16_t)))
+
+// Cursor location past the end of video memory, so it is not shown
+#define CURSOR_HIDDEN (VGA_MEMORY_ROWS * VGA_WIDTH)
+
+static uint8_t make_color(enum vga_color fg, enum vga_color bg) {
+    return fg | bg << 4;
+}
+
+static uint16_t make_vgaentry(char c, uint8_t color) {
+    uint16_t c16 = (uint8_t)c;
+    uint16_t color16 = color;
+    return c16 | color16 << 8;
+}
+
+// VGA text mode driver. Video memory is treated as a tall window that
+// the CRTC start address slides over, so scrolling by less than a
+// screen only draws the rows it uncovers. When the window runs out the
+// screen is redrawn at the other end of it.
+static size_t vga_origin = 0;       // Window row holding screen row 0
+static size_t hw_origin = (size_t)-1;
+static uint16_t hw_cursor_pos = 0xFFFF;
+
+static void crtc_write16(uint8_t high_reg, uint8_t low_reg, uint16_t value) {
+    outb(CRTC_INDEX_PORT, high_reg);
+    outb(CRTC_DATA_PORT, value >> 8);
+    outb(CRTC_INDEX_PORT, low_reg);
+    outb(CRTC_DATA_PORT, value & 0xFF);
+}
+
+// Copy one row to video memory with 32-bit stores
+static void vga_draw_row(size_t row, const uint16_t* cells) {
+    const uint32_t* src = (const uint32_t*)cells;
+    volatile uint32_t* dst = (volatile uint32_t*)VGA_MEMORY + (vga_origin + row) * (VGA_WIDTH / 2);
+    for (size_t i = 0; i < VGA_WIDTH / 2; i++) {
+        dst[i] = src[i];
+    }
+}
+
+static bool vga_scroll(int lines) {
+    int origin = (int)vga_origin + lines;
+    bool kept = origin >= 0 && origin + VGA_HEIGHT <= (int)VGA_MEMORY_ROWS;
+
+    if (kept) {
+        vga_origin = origin;
+    } else {
+        vga_origin = lines > 0 ? 0 : VGA_MEMORY_ROWS - VGA_HEIGHT;
+    }
+    if (vga_origin != hw_origin) {
+        crtc_write16(CRTC_START_HIGH, CRTC_START_LOW, vga_origin * VGA_WIDTH);
+        hw_origin = vga_origin;
+    }
+    return kept;
+}
+
+static void vga_set_cursor(size_t row, size_t col, bool visible) {
+    uint16_t location = visible ? (vga_origin + row) * VGA_WIDTH + col : CURSOR_HIDDEN;
+    if (location != hw_cursor_pos) {
+        crtc_write16(CRTC_CURSOR_HIGH, CRTC_CURSOR_LOW, location);
+        hw_cursor_pos = location;
+    }
+}
+
+static const struct console_driver vga_driver = {
+    VGA_WIDTH, VGA_HEIGHT, vga_draw_row, vga_scroll, vga_set_cursor
+};
+
+#ifndef TERMINAL_SCROLLBACK_LINES
+#define TERMINAL_SCROLLBACK_LINES 10000
+#endif
+
+// The terminal renders into a RAM shadow of the screen. Rows touched
+// since the last flush are tracked in dirty_rows and passed to the
+// driver at the end of each terminal call, or once when the outermost
+// terminal_end_update() runs. The cursor is handled the same way:
+// moves only record the position and the flush shows it.
+//
+// The shadow is the tail of a ring of lines that also holds the
+// scrollback, so scrolling moves no cells: live_top advances one line
+// and the line that falls off the top of the screen becomes history.
+// The screen shows the rows lines starting view_offset lines above
+// live_top, and a changed view is drawn by asking the driver to scroll.
+#define NO_LINE ((size_t)-1)
+
+static uint16_t line_ring[(TERMINAL_SCROLLBACK_LINES + TERMINAL_MAX_ROWS) * TERMINAL_MAX_COLS];
+static const struct console_driver* driver = &vga_driver;
+static size_t cols = VGA_WIDTH;
+static size_t rows = VGA_HEIGHT;
+static size_t ring_lines = TERMINAL_SCROLLBACK_LINES + VGA_HEIGHT;
+static size_t live_top = 0;         // Ring line shown at live row 0
+static size_t history_lines = 0;    // Lines above live_top that hold output
+static size_t view_offset = 0;      // How far the view is scrolled back
+static uint64_t dirty_rows = 0;     // Live rows changed since the flush
+static unsigned update_depth = 0;
+static uint16_t cursor_pos = 0;
+static bool cursor_visible = true;
+static size_t hw_top = NO_LINE;     // Ring line the driver shows at row 0
+
+static_assert(TERMINAL_MAX_ROWS <= 64, "dirty_rows needs one bit per row");
+static_assert(VGA_WIDTH % 2 == 0, "rows are drawn two cells at a time");
+
+// Mask of screen rows [0, count)
+static uint64_t low_rows(size_t count) {
+    return count >= 64 ? ~0ull : (1ull << count) - 1;
+}
+
+// Ring line delta lines after base; delta must be below ring_lines
+static size_t ring_line(size_t base, size_t delta) {
+    base += delta;
+    if (base >= ring_lines) {
+        base -= ring_lines;
+    }
+    return base;
+}
+
+static uint16_t* line_cells(size_t line) {
+    return &line_ring[line * cols];
+}
+
+static uint16_t* row_cells(size_t row) {
+    return line_cells(ring_line(live_top, row));
+}
+
+static void mark_dirty(size_t row) {
+    dirty_rows |= 1ull << row;
+}
+
+// Set cells [from, to) of a row, marking it dirty only if one changed
+static void fill_cells(size_t row, size_t from, size_t to, uint16_t entry) {
+    uint16_t* cells = row_cells(row);
+    uint16_t changed = 0;
+    for (size_t x = from; x < to; x++) {
+        changed |= cells[x] ^ entry;
+        cells[x] = entry;
+    }
+    if (changed) {
+        mark_dirty(row);
+    }
+}
+
+static void fill_row(size_t row, uint16_t entry) {
+    fill_cells(row, 0, cols, entry);
+}
+
+// Bring the driver's screen to ring line top. Returns the screen rows
+// that do not already show their line.
+static uint64_t move_view(size_t top) {
+    if (hw_top == top) {
+        return 0;
+    }
+    size_t previous = hw_top;
+    hw_top = top;
+    if (previous == NO_LINE) {
+        return low_rows(rows);
+    }
+
+    size_t ahead = ring_line(top, ring_lines - previous);
+    size_t behind = ring_lines - ahead;
+
+    if (ahead < rows) {
+        if (driver->scroll(ahead)) {
+            return low_rows(rows) & ~low_rows(rows - ahead);
+        }
+    } else if (behind < rows) {
+        if (driver->scroll(-(int)behind)) {
+            return low_rows(behind);
+        }
+    }
+    return low_rows(rows);
+}
+
+void terminal_flush() {
+    size_t top = ring_line(live_top, ring_lines - view_offset);
+
+    // Live rows that are currently on screen, in screen coordinates
+    uint64_t redraw = view_offset < rows ? (dirty_rows << view_offset) & low_rows(rows) : 0;
+    dirty_rows = 0;
+    redraw |= move_view(top);
+
+    while (redraw) {
+        size_t row = __builtin_ctzll(redraw);
+        redraw &= redraw - 1;
+        driver->draw_row(row, line_cells(ring_line(top, row)));
+    }
+
+    // The cursor stays with the live screen while the view is scrolled
+    size_t shown = cursor_pos + view_offset * cols;
+    if (cursor_visible && shown < cols * rows) {
+        size_t row = shown / cols;
+        driver->set_cursor(row, shown - row * cols, true);
+    } else {
+        driver->set_cursor(0, 0, false);
+    }
+}
+
+// Flush unless a batched update is in progress
+static void terminal_commit() {
+    if (update_depth == 0) {
+        terminal_flush();
+    }
+}
+
+void terminal_begin_update() {
+    update_depth++;
+}
+
+void terminal_end_update() {
+    if (update_depth > 0 && --update_depth == 0) {
+        terminal_flush();
+    }
+}
+
+void terminal_scroll_view(int lines) {
+    int target = (int)view_offset + lines;
+    if (target < 0) {
+        target = 0;
+    } else if ((size_t)target > history_lines) {
+        target = history_lines;
+    }
+    view_offset = target;
+    terminal_commit();
+}
+
+void terminal_reset_view() {
+    if (view_offset) {
+        view_offset = 0;
+        terminal_commit();
+    }
+}
+
+// Escape sequence parser state. CSI sequences are ESC [, optional
+// '?', up to CSI_MAX_PARAMS numeric parameters separated by ';', and
+// a final byte.
+#define CSI_MAX_PARAMS 8
+
+enum escape_state {
+    ESCAPE_NONE,
+    ESCAPE_START,   // After ESC
+    ESCAPE_CSI      // After ESC [
+};
+
+static enum escape_state escape = ESCAPE_NONE;
+static unsigned csi_params[CSI_MAX_PARAMS];
+static size_t csi_count;
+static bool csi_private;
+
+// Scroll region rows, inclusive
+static size_t scroll_top = 0;
+static size_t scroll_bottom = VGA_HEIGHT - 1;
+
+// SGR colour state; terminal_color is derived from it
+static uint8_t fg_color = VGA_COLOR_LIGHT_GREY;
+static uint8_t bg_color = VGA_COLOR_BLACK;
+static bool sgr_bold = false;
+static bool sgr_reverse = false;
+
+// Position saved by ESC 7 / CSI s
+static size_t saved_row = 0;
+static size_t saved_column = 0;
+
+// ANSI colour numbers in VGA order
+static const uint8_t ansi_to_vga[8] = {
+    VGA_COLOR_BLACK, VGA_COLOR_RED, VGA_COLOR_GREEN, VGA_COLOR_BROWN,
+    VGA_COLOR_BLUE, VGA_COLOR_MAGENTA, VGA_COLOR_CYAN, VGA_COLOR_LIGHT_GREY
+};
+
+static void apply_color() {
+    uint8_t fg = fg_color | (sgr_bold ? 0x08 : 0);
+    uint8_t bg = bg_color;
+    if (sgr_reverse) {
+        uint8_t t = fg;
+        fg = bg;
+        bg = t;
+    }
+    kernel_state.terminal_color = make_color((enum vga_color)fg, (enum vga_color)bg);
+}
+
+static uint16_t blank_entry() {
+    return make_vgaentry(' ', kernel_state.terminal_color);
+}
+
+// Back to a clear screen with default colours and no scroll region
+static void terminal_reset() {
+    escape = ESCAPE_NONE;
+    scroll_top = 0;
+    scroll_bottom = rows - 1;
+    fg_color = VGA_COLOR_LIGHT_GREY;
+    bg_color = VGA_COLOR_BLACK;
+    sgr_bold = false;
+    sgr_reverse = false;
+    cursor_visible = true;
+    apply_color();
+    terminal_clear();
+}
+
+void terminal_set_driver(const struct console_driver* new_driver) {
+    driver = new_driver;
+    cols = driver->cols < TERMINAL_MAX_COLS ? driver->cols : TERMINAL_MAX_COLS;
+    rows = driver->rows < TERMINAL_MAX_ROWS ? driver->rows : TERMINAL_MAX_ROWS;
+    ring_lines = TERMINAL_SCROLLBACK_LINES + rows;
+
+    // The ring is laid out for the old width, so start it over
+    live_top = 0;
+    history_lines = 0;
+    view_offset = 0;
+    hw_top = NO_LINE;
+    terminal_reset();
+}
+
+void terminal_init() {
+    kernel_state.terminal_buffer = line_ring;
+    kernel_state.is_initialized = true;
+    terminal_reset();
+}
+
+// Put the cursor at the write position. A column of cols means the
+// last cell was just written and the next character wraps, as on a
+// VT100; the cursor stays on the last cell meanwhile.
+static void follow_cursor() {
+    size_t column = kernel_state.terminal_column;
+    if (column == cols) {
+        column--;
+    }
+    cursor_pos = kernel_state.terminal_row * cols + column;
+}
+
+static void terminal_goto(size_t x, size_t y) {
+    kernel_state.terminal_column = x < cols ? x : cols - 1;
+    kernel_state.terminal_row = y < rows ? y : rows - 1;
+}
+
+void terminal_clear() {
+    for (size_t y = 0; y < rows; y++) {
+        fill_row(y, blank_entry());
+    }
+    terminal_goto(0, 0);
+    follow_cursor();
+    terminal_commit();
+}
+
+void terminal_set_cursor(size_t x, size_t y) {
+    terminal_goto(x, y);
+    follow_cursor();
+    terminal_commit();
+}
+
+void terminal_get_cursor(size_t* x, size_t* y) {
+    size_t column = kernel_state.terminal_column;
+    *x = column == cols ? cols - 1 : column;
+    *y = kernel_state.terminal_row;
+}
+
+void terminal_movecursor(size_t x, size_t y) {
+    terminal_set_cursor(x, y);
+}
+
+void terminal_set_color(enum vga_color fg, enum vga_color bg) {
+    fg_color = fg;
+    bg_color = bg;
+    sgr_bold = false;
+    sgr_reverse = false;
+    apply_color();
+}
+
+static void terminal_scroll() {
+    live_top = ring_line(live_top, 1);
+    if (history_lines < TERMINAL_SCROLLBACK_LINES) {
+        history_lines++;
+    }
+
+    // Keep a scrolled-back view on the same lines. The old top row is
+    // still on screen then, so it cannot simply drop its dirty bit.
+    if (view_offset) {
+        if (dirty_rows & 1) {
+            hw_top = NO_LINE;
+        }
+        if (view_offset < history_lines) {
+            view_offset++;
+        }
+    }
+    dirty_rows >>= 1;
+
+    // Once the ring is full this reuses the oldest history line
+    uint16_t* cells = row_cells(rows - 1);
+    for (size_t x = 0; x < cols; x++) {
+        cells[x] = blank_entry();
+    }
+    mark_dirty(rows - 1);
+}
+
+// Scroll the region up by one line. Only a full-screen region feeds
+// the scrollback; a partial one shifts its rows in place.
+static void scroll_region_up() {
+    if (scroll_top == 0 && scroll_bottom == rows - 1) {
+        terminal_scroll();
+        return;
+    }
+    for (size_t y = scroll_top; y < scroll_bottom; y++) {
+        memcpy(row_cells(y), row_cells(y + 1), cols * sizeof(uint16_t));
+        mark_dirty(y);
+    }
+    fill_row(scroll_bottom, blank_entry());
+}
+
+static void scroll_region_down() {
+    for (size_t y = scroll_bottom; y > scroll_top; y--) {
+        memcpy(row_cells(y), row_cells(y - 1), cols * sizeof(uint16_t));
+        mark_dirty(y);
+    }
+    fill_row(scroll_top, blank_entry());
+}
+
+static void terminal_line_feed() {
+    if (kernel_state.terminal_row == scroll_bottom) {
+        scroll_region_up();
+    } else if (kernel_state.terminal_row + 1 < rows) {
+        kernel_state.terminal_row++;
+    }
+}
+
+static void terminal_advance_line() {
+    kernel_state.terminal_column = 0;
+    terminal_line_feed();
+}
+
+// Parameter n of the current CSI sequence, or fallback if it was
+// omitted or zero
+static unsigned csi_param(size_t n, unsigned fallback) {
+    return n < csi_count && csi_params[n] ? csi_params[n] : fallback;
+}
+
+// Lines to scroll for S and T. Beyond the region's height the result is
+// the same blank region, so larger counts are clamped as VT terminals do.
+static unsigned csi_scroll_count() {
+    unsigned count = csi_param(0, 1);
+    size_t height = scroll_bottom - scroll_top + 1;
+    return count < height ? count : height;
+}
+
+static void csi_erase_line(unsigned mode) {
+    size_t row = kernel_state.terminal_row;
+    size_t column = kernel_state.terminal_column;
+    if (column == cols) {
+        column--;
+    }
+    switch (mode) {
+        case 0: fill_cells(row, column, cols, blank_entry()); break;
+        case 1: fill_cells(row, 0, column + 1, blank_entry()); break;
+        case 2: fill_row(row, blank_entry()); break;
+    }
+}
+
+static void csi_erase_display(unsigned mode) {
+    size_t row = kernel_state.terminal_row;
+    switch (mode) {
+        case 0:
+            csi_erase_line(0);
+            for (size_t y = row + 1; y < rows; y++) {
+                fill_row(y, blank_entry());
+            }
+            break;
+        case 1:
+            for (size_t y = 0; y < row; y++) {
+                fill_row(y, blank_entry());
+            }
+            csi_erase_line(1);
+            break;
+        case 2:
+        case 3:
+            for (size_t y = 0; y < rows; y++) {
+                fill_row(y, blank_entry());
+            }
+            break;
+    }
+}
+
+static void csi_select_graphic_rendition() {
+    if (csi_count == 0) {
+        csi_count = 1;
+        csi_params[0] = 0;
+    }
+    for (size_t i = 0; i < csi_count; i++) {
+        unsigned p = csi_params[i];
+        if (p == 0) {
+            fg_color = VGA_COLOR_LIGHT_GREY;
+            bg_color = VGA_COLOR_BLACK;
+            sgr_bold = false;
+            sgr_reverse = false;
+        } else if (p == 1) {
+            sgr_bold = true;
+        } else if (p == 22) {
+            sgr_bold = false;
+        } else if (p == 7) {
+            sgr_reverse = true;
+        } else if (p == 27) {
+            sgr_reverse = false;
+        } else if (p >= 30 && p <= 37) {
+            fg_color = ansi_to_vga[p - 30];
+        } else if (p == 39) {
+            fg_color = VGA_COLOR_LIGHT_GREY;
+        } else if (p >= 40 && p <= 47) {
+            bg_color = ansi_to_vga[p - 40];
+        } else if (p == 49) {
+            bg_color = VGA_COLOR_BLACK;
+        } else if (p >= 90 && p <= 97) {
+            fg_color = ansi_to_vga[p - 90] | 0x08;
+        } else if (p >= 100 && p <= 107) {
+            bg_color = ansi_to_vga[p - 100] | 0x08;
+        }
+    }
+    apply_color();
+}
+
+static void csi_dispatch(char final) {
+    size_t row = kernel_state.terminal_row;
+    size_t column = kernel_state.terminal_column;
+    if (column == cols) {
+        column--;
+    }
+
+    switch (final) {
+        case 'A':  // Cursor up
+            terminal_goto(column, row - (row < csi_param(0, 1) ? row : csi_param(0, 1)));
+            break;
+        case 'B':  // Cursor down
+            terminal_goto(column, row + csi_param(0, 1));
+            break;
+        case 'C':  // Cursor forward
+            terminal_goto(column + csi_param(0, 1), row);
+            break;
+        case 'D':  // Cursor back
+            terminal_goto(column - (column < csi_param(0, 1) ? column : csi_param(0, 1)), row);
+            break;
+        case 'H':  // Cursor position, 1-based row;column
+        case 'f':
+            terminal_goto(csi_param(1, 1) - 1, csi_param(0, 1) - 1);
+            break;
+        case 'J':
+            csi_erase_display(csi_param(0, 0));
+            break;
+        case 'K':
+            csi_erase_line(csi_param(0, 0));
+            break;
+        case 'S':  // Scroll up
+            for (unsigned n = csi_scroll_count(); n; n--) {
+                scroll_region_up();
+            }
+            break;
+        case 'T':  // Scroll down
+            for (unsigned n = csi_scroll_count(); n; n--) {
+                scroll_region_down();
+            }
+            break;
+        case 'm':
+            csi_select_graphic_rendition();
+            break;
+        case 'r': {  // Set scroll region, 1-based top;bottom
+            size_t top = csi_param(0, 1) - 1;
+            size_t bottom = csi_param(1, rows) - 1;
+            if (bottom >= rows) {
+                bottom = rows - 1;
+            }
+            if (top < bottom) {
+                scroll_top = top;
+                scroll_bottom = bottom;
+                terminal_goto(0, 0);
+            }
+            break;
+        }
+        case 's':
+            saved_row = row;
+            saved_column = column;
+            break;
+        case 'u':
+            terminal_goto(saved_column, saved_row);
+            break;
+        case 'h':  // ?25h shows the cursor
+        case 'l':  // ?25l hides it
+            if (csi_private && csi_param(0, 0) == 25) {
+                cursor_visible = final == 'h';
+            }
+            break;
+    }
+}
+
+static void terminal_escape_char(char c) {
+    if (escape == ESCAPE_START) {
+        escape = ESCAPE_NONE;
+        if (c == '[') {
+            escape = ESCAPE_CSI;
+            csi_count = 0;
+            csi_private = false;
+            csi_params[0] = 0;
+        } else if (c == '7') {
+            saved_row = kernel_state.terminal_row;
+            saved_column = kernel_state.terminal_column;
+        } else if (c == '8') {
+            terminal_goto(saved_column, saved_row);
+        } else if (c == 'c') {
+            terminal_reset();
+        }
+        return;
+    }
+
+    if (c >= '0' && c <= '9') {
+        if (csi_count == 0) {
+            csi_count = 1;
+        }
+        if (csi_count <= CSI_MAX_PARAMS) {
+            unsigned* p = &csi_params[csi_count - 1];
+            *p = *p * 10 + (c - '0');
+        }
+    } else if (c == ';') {
+        if (csi_count == 0) {
+            csi_count = 1;
+        }
+        if (++csi_count <= CSI_MAX_PARAMS) {
+            csi_params[csi_count - 1] = 0;
+        }
+    } else if (c == '?') {
+        csi_private = true;
+    } else if (c >= 0x40 && c <= 0x7E) {
+        if (csi_count > CSI_MAX_PARAMS) {
+            csi_count = CSI_MAX_PARAMS;
+        }
+        escape = ESCAPE_NONE;
+        csi_dispatch(c);
+    } else if (c == 0x18 || c == 0x1A) {
+        escape = ESCAPE_NONE;  // CAN and SUB abort the sequence
+    }
+}
+
+static void terminal_put_char(char c) {
+    if (escape != ESCAPE_NONE && c != 0x1B) {
+        terminal_escape_char(c);
+        return;
+    }
+
+    switch (c) {
+        case '\n':
+            terminal_advance_line();
+            return;
+        case '\r':
+            kernel_state.terminal_column = 0;
+            return;
+        case '\b':
+            if (kernel_state.terminal_column == cols) {
+                kernel_state.terminal_column--;
+            }
+            if (kernel_state.terminal_column > 0) {
+                kernel_state.terminal_column--;
+            }
+            return;
+        case '\t': {
+            size_t column = kernel_state.terminal_column;
+            if (column < cols) {
+                column = (column | 7) + 1;
+                kernel_state.terminal_column = column < cols ? column : cols - 1;
+            }
+            return;
+        }
+        case 0x1B:
+            escape = ESCAPE_START;
+            return;
+    }
+    if ((uint8_t)c < 0x20) {
+        return;  // Other control characters are ignored
+    }
+
+    if (kernel_state.terminal_column == cols) {
+        terminal_advance_line();
+    }
+    uint16_t entry = make_vgaentry(c, kernel_state.terminal_color);
+    uint16_t* cell = &row_cells(kernel_state.terminal_row)[kernel_state.terminal_column++];
+    if (*cell != entry) {
+        *cell = entry;
+        mark_dirty(kernel_state.terminal_row);
+    }
+}
+
+static bool is_control(char c) {
+    return (uint8_t)c < 0x20;
+}
+
+// Write a run of printable bytes. Cells are stored two at a time and
+// wrapping is checked once per row rather than once per byte. Rows
+// whose cells come out unchanged are not marked dirty.
+static void terminal_put_run(const char* data, size_t length) {
+    uint32_t attr = (uint32_t)kernel_state.terminal_color << 8;
+    uint32_t attr_pair = attr | attr << 16;
+
+    while (length) {
+        if (kernel_state.terminal_column == cols) {
+            terminal_advance_line();
+        }
+        size_t column = kernel_state.terminal_column;
+        size_t count = cols - column;
+        if (count > length) {
+            count = length;
+        }
+
+        const uint8_t* src = (const uint8_t*)data;
+        uint16_t* cells = row_cells(kernel_state.terminal_row) + column;
+        uint32_t changed = 0;
+        size_t i = 0;
+        if ((uintptr_t)cells & 2) {
+            changed |= cells[i] ^ (attr | src[i]);
+            cells[i] = attr | src[i];
+            i++;
+        }
+        for (; i + 2 <= count; i += 2) {
+            uint32_t pair = attr_pair | src[i] | (uint32_t)src[i + 1] << 16;
+            uint32_t old;
+            __builtin_memcpy(&old, &cells[i], sizeof(old));
+            changed |= old ^ pair;
+            __builtin_memcpy(&cells[i], &pair, sizeof(pair));
+        }
+        if (i < count) {
+            changed |= cells[i] ^ (attr | src[i]);
+            cells[i] = attr | src[i];
+        }
+        if (changed) {
+            mark_dirty(kernel_state.terminal_row);
+        }
+
+        data += count;
+        length -= count;
+        kernel_state.terminal_column = column + count;
+    }
+}
+
+// Everything written to the terminal is mirrored to COM1 for headless
+// runs, escape sequences included
+void terminal_write_char(char c) {
+    serial_write_char(c);
+    terminal_put_char(c);
+    follow_cursor();
+    terminal_commit();
+}
+
+void terminal_write(const char* data, size_t size) {
+    serial_write(data, size);
+    size_t i = 0;
+    while (i < size) {
+        size_t end = i;
+        if (escape == ESCAPE_NONE) {
+            while (end < size && !is_control(data[end])) {
+                end++;
+            }
+        }
+        if (end > i) {
+            terminal_put_run(data + i, end - i);
+            i = end;
+        } else {
+            terminal_put_char(data[i++]);
+        }
+    }
+    follow_cursor();
+    terminal_commit();
+}
+
+void terminal_write_string(const char* data) {
+    serial_write_string(data);
+    size_t i = 0;
+    while (data[i] != '\0') {
+        // The terminating NUL is a control character and ends a run
+        size_t end = i;
+        if (escape == ESCAPE_NONE) {
+            while (!is_control(data[end])) {
+                end++;
+            }
+        }
+        if (end > i) {
+            terminal_put_run(data + i, end - i);
+            i = end;
+        } else {
+            terminal_put_char(data[i++]);
+        }
+    }
+    follow_cursor();
+    terminal_commit();
+}
+
+void terminal_new_line() {
+    serial_write_char('\n');
+    terminal_advance_line();
+    follow_cursor();
+    terminal_commit();
+}
+
+void terminal_backspace() {
+    if (kernel_state.terminal_column > 0) {
+        serial_write_string("\b \b");
+        kernel_state.terminal_column--;
+        fill_cells(kernel_state.terminal_row, kernel_state.terminal_column,
+                   kernel_state.terminal_column + 1, blank_entry());
+        follow_cursor();
+        terminal_commit();
+    }
+}
+
+void terminal_get_size(size_t* rows_out, size_t* cols_out) {
+    *rows_out = rows;
+    *cols_out = cols;
+}
@@ -0,0 +1,310 @@
+#include "timer.h"
+#include "interrupts.h"
+#include "kernel.h"
+#include "apic.h"
+#include "clock.h"
+
+// PIT channel 0 drives IRQ0
+#define PIT_CHANNEL0   0x40
+#define PIT_COMMAND    0x43
+#define PIT_FREQUENCY  1193182
+#define PIT_MODE_RATE  0x34     // Channel 0, lobyte/hibyte, rate generator
+
+#define PIT_DIVISOR ((PIT_FREQUENCY + TIMER_HZ / 2) / TIMER_HZ)
+static_assert(PIT_DIVISOR >= 1 && PIT_DIVISOR <= 65536, "TIMER_HZ out of the PIT's range");
+
+// Hierarchical timer wheel. The first level has one slot per tick for
+// the next 256 ticks; each further level covers 64 times the span of
+// the one below, and its slots are cascaded down as the first level
+// wraps. Insert and cancel only link or unlink a list node.
+#define WHEEL_ROOT_BITS  8
+#define WHEEL_LEVEL_BITS 6
+#define WHEEL_LEVELS     3      // Above the root
+#define WHEEL_ROOT_SIZE  (1u << WHEEL_ROOT_BITS)
+#define WHEEL_LEVEL_SIZE (1u << WHEEL_LEVEL_BITS)
+#define WHEEL_MAX_DELAY  ((1u << (WHEEL_ROOT_BITS + WHEEL_LEVELS * WHEEL_LEVEL_BITS)) - 1)
+
+static struct timer* wheel_root[WHEEL_ROOT_SIZE];
+static struct timer* wheel_levels[WHEEL_LEVELS][WHEEL_LEVEL_SIZE];
+
+static volatile uint32_t tick = 0;
+static uint32_t wheel_tick = 0;     // Next tick the wheel will run
+
+// Tickless idle state, used with the local APIC timer only
+static bool lapic_tick = false;     // The tick comes from the local APIC timer
+static bool idle_oneshot = false;   // Periodic tick stopped for an idle period
+static uint32_t idle_start = 0;     // Counts into the tick period at entry
+static uint32_t idle_count = 0;     // One-shot count programmed at entry
+static bool resync_period = false;  // Current period shortened to keep the phase
+static bool skip_oneshot = false;   // One-shot raised late, already counted
+static uint32_t tick_cycles = 0;    // TSC cycles per tick
+
+// The wheel runs as a bottom half. Ticks with nothing due don't schedule
+// it, so wheel_tick may trail the tick count; every slot in between is
+// empty, and the wrap to slot 0 always schedules it for the cascade.
+static struct tasklet wheel_tasklet;
+
+static void list_add(struct timer** head, struct timer* timer) {
+    timer->next = *head;
+    if (timer->next) {
+        timer->next->pprev = &timer->next;
+    }
+    *head = timer;
+    timer->pprev = head;
+}
+
+static void list_del(struct timer* timer) {
+    *timer->pprev = timer->next;
+    if (timer->next) {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->pprev = nullptr;
+}
+
+// Slot for a timer relative to the wheel's position
+static void wheel_insert(struct timer* timer) {
+    uint32_t expires = timer->expires;
+    uint32_t delta = expires - wheel_tick;
+
+    if ((int32_t)delta < 0) {
+        // Already due: run on the next tick
+        list_add(&wheel_root[wheel_tick & (WHEEL_ROOT_SIZE - 1)], timer);
+        return;
+    }
+    if (delta > WHEEL_MAX_DELAY) {
+        expires = wheel_tick + WHEEL_MAX_DELAY;
+        timer->expires = expires;
+        delta = WHEEL_MAX_DELAY;
+    }
+    if (delta < WHEEL_ROOT_SIZE) {
+        list_add(&wheel_root[expires & (WHEEL_ROOT_SIZE - 1)], timer);
+        return;
+    }
+    unsigned level = 0;
+    while (delta >= (1u << (WHEEL_ROOT_BITS + (level + 1) * WHEEL_LEVEL_BITS))) {
+        level++;
+    }
+    unsigned shift = WHEEL_ROOT_BITS + level * WHEEL_LEVEL_BITS;
+    list_add(&wheel_levels[level][(expires >> shift) & (WHEEL_LEVEL_SIZE - 1)], timer);
+}
+
+// Move one slot of a level down the wheel. Returns the slot index, which
+// is 0 when the next level up has wrapped too.
+static unsigned cascade(unsigned level) {
+    unsigned shift = WHEEL_ROOT_BITS + level * WHEEL_LEVEL_BITS;
+    unsigned index = (wheel_tick >> shift) & (WHEEL_LEVEL_SIZE - 1);
+
+    struct timer* list = wheel_levels[level][index];
+    wheel_levels[level][index] = nullptr;
+    while (list) {
+        struct timer* timer = list;
+        list = timer->next;
+        wheel_insert(timer);
+    }
+    return index;
+}
+
+// Fire everything due up to now. Runs from the timer tasklet; the wheel
+// is only touched with interrupts off, so handlers may add timers, and
+// callbacks run with interrupts on.
+static void wheel_run(uint32_t now) {
+    uint32_t flags = irq_save();
+    while ((int32_t)(now - wheel_tick) >= 0) {
+        unsigned index = wheel_tick & (WHEEL_ROOT_SIZE - 1);
+        if (index == 0) {
+            for (unsigned level = 0; level < WHEEL_LEVELS && cascade(level) == 0; level++) {
+            }
+        }
+
+        // Detach the slot so callbacks can add timers to it for later
+        struct timer* expired = wheel_root[index];
+        wheel_root[index] = nullptr;
+        if (expired) {
+            expired->pprev = &expired;
+        }
+        wheel_tick++;
+
+        while (expired) {
+            struct timer* timer = expired;
+            list_del(timer);
+            irq_restore(flags);
+            timer->fn(timer->ctx);
+            flags = irq_save();
+        }
+    }
+    irq_restore(flags);
+}
+
+static void timer_expire(void* ctx) {
+    (void)ctx;  // Unused parameter
+    wheel_run(tick);
+}
+
+// Ticks from now until the wheel next has work: its first occupied root
+// slot, or the next root wrap, where the upper levels cascade
+static uint32_t wheel_idle_ticks() {
+    for (uint32_t i = 0; i < WHEEL_ROOT_SIZE; i++) {
+        uint32_t next = wheel_tick + i;
+        unsigned index = next & (WHEEL_ROOT_SIZE - 1);
+        if (wheel_root[index] || index == 0) {
+            return next - tick;
+        }
+    }
+    return WHEEL_ROOT_SIZE;
+}
+
+static void timer_handler(struct registers* regs, void* ctx) {
+    (void)regs;  // Unused parameters
+    (void)ctx;
+    if (idle_oneshot || skip_oneshot) {
+        skip_oneshot = false;
+        return;  // Counted by timer_idle_exit()
+    }
+    if (resync_period) {
+        // This period was cut short to stay in phase; restore the length
+        resync_period = false;
+        lapic_timer_periodic(lapic_timer_period());
+    } else if (lapic_tick) {
+        // The count reloads as the interrupt is raised, so how far it has
+        // counted since is how late the handler runs. Reading the PIT's
+        // count would take three slow port accesses per tick, so only
+        // the APIC timer reports this.
+        uint32_t period = lapic_timer_period();
+        uint32_t counted = period - lapic_timer_remaining();
+        interrupt_record_latency((uint32_t)clock_div_u64((uint64_t)counted * tick_cycles, period, nullptr));
+    }
+
+    uint32_t now = tick + 1;
+    tick = now;
+    unsigned index = now & (WHEEL_ROOT_SIZE - 1);
+    if (wheel_root[index] || index == 0) {
+        tasklet_schedule(&wheel_tasklet);
+    }
+}
+
+// Prefer the local APIC timer, which takes no port I/O to acknowledge;
+// the PIT drives the tick otherwise
+void timer_init() {
+    wheel_tick = tick + 1;
+    tasklet_init(&wheel_tasklet, timer_expire, nullptr);
+
+    if (lapic_timer_start(TIMER_HZ, APIC_TIMER_VECTOR)) {
+        tick_cycles = (uint32_t)clock_div_u64((uint64_t)clock_tsc_khz() * 1000, TIMER_HZ, nullptr);
+        register_interrupt_handler(APIC_TIMER_VECTOR, timer_handler, nullptr);
+        irq_set_masked(0, true);
+        lapic_tick = true;
+        return;
+    }
+
+    outb(PIT_COMMAND, PIT_MODE_RATE);
+    outb(PIT_CHANNEL0, PIT_DIVISOR & 0xFF);
+    outb(PIT_CHANNEL0, (PIT_DIVISOR >> 8) & 0xFF);
+    register_interrupt_handler(IRQ_VECTOR(0), timer_handler, nullptr);
+}
+
+extern "C" uint32_t kernel_get_ticks() {
+    return tick;
+}
+
+extern "C" uint32_t timer_ms_to_ticks(uint32_t ms) {
+    // Rounded up, and split so nothing overflows 32 bits
+    return ms / 1000 * TIMER_HZ + (ms % 1000 * TIMER_HZ + 999) / 1000;
+}
+
+extern "C" void timer_add(struct timer* timer, uint32_t delay_ms, timer_fn_t fn, void* ctx) {
+    uint32_t flags = irq_save();
+    if (timer->pprev) {
+        list_del(timer);
+    }
+    timer->fn = fn;
+    timer->ctx = ctx;
+    // The current tick is already partly over, so wait one more
+    timer->expires = tick + timer_ms_to_ticks(delay_ms) + 1;
+    wheel_insert(timer);
+    irq_restore(flags);
+}
+
+extern "C" bool timer_cancel(struct timer* timer) {
+    uint32_t flags = irq_save();
+    bool pending = timer->pprev != nullptr;
+    if (pending) {
+        list_del(timer);
+    }
+    irq_restore(flags);
+    return pending;
+}
+
+extern "C" bool timer_pending(const struct timer* timer) {
+    return __atomic_load_n(&timer->pprev, __ATOMIC_ACQUIRE) != nullptr;
+}
+
+extern "C" void timer_idle_enter() {
+    // A tick already raised but not yet delivered would be lost
+    if (!lapic_tick || lapic_timer_pending()) {
+        return;
+    }
+    uint32_t ticks = wheel_idle_ticks();
+    if (ticks < 2) {
+        return;
+    }
+
+    // Wake on the tick boundary the deadline falls on
+    uint32_t period = lapic_timer_period();
+    uint32_t remaining = lapic_timer_remaining();
+    idle_start = period - remaining;
+    idle_count = remaining + (ticks - 1) * period;
+    idle_oneshot = true;
+    lapic_timer_oneshot(idle_count);
+}
+
+extern "C" void timer_idle_exit() {
+    uint32_t flags = irq_save();
+    if (!idle_oneshot) {
+        irq_restore(flags);
+        return;
+    }
+
+    // Mask the one-shot so it can't be raised after it is counted. If it
+    // was raised before that, it has fully run down and its delivery,
+    // still waiting in the APIC, is counted here and skipped.
+    lapic_timer_mask();
+    uint32_t remaining = lapic_timer_remaining();
+    if (lapic_timer_pending()) {
+        remaining = 0;
+        skip_oneshot = true;
+    }
+
+    // Whole ticks slept through, and how far into the current one we are
+    uint32_t period = lapic_timer_period();
+    uint32_t position = idle_start + (idle_count - remaining);
+    uint32_t elapsed = position / period;
+    uint32_t into_period = position % period;
+
+    idle_oneshot = false;
+    lapic_timer_periodic(period - into_period);
+    resync_period = into_period != 0;
+
+    if (elapsed) {
+        tick += elapsed;
+        tasklet_schedule(&wheel_tasklet);
+    }
+    irq_restore(flags);
+}
+
+static void sleep_wake(void* ctx) {
+    *(volatile bool*)ctx = true;
+}
+
+extern "C" void sleep_ms(uint32_t ms) {
+    volatile bool done = false;
+    struct timer timer = {};
+    timer_add(&timer, ms, sleep_wake, (void*)&done);
+
+    // Check with interrupts off so the wakeup can't slip in before the hlt
+    irq_disable();
+    while (!done) {
+        cpu_idle();
+        irq_disable();
+    }
+    irq_enable();
+}
@@ -0,0 +1,61 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// PIT interrupt rate; the divisor must fit in 16 bits
+#ifndef TIMER_HZ
+#define TIMER_HZ 1000
+#endif
+
+typedef void (*timer_fn_t)(void* ctx);
+
+// A pending callback, owned by the caller and linked into the timer
+// wheel until it fires or is cancelled
+struct timer {
+    struct timer* next;
+    struct timer** pprev;   // nullptr while not pending
+    uint32_t expires;       // Tick the timer fires on
+    timer_fn_t fn;
+    void* ctx;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Program the PIT and take over IRQ0
+void timer_init(void);
+
+// Ticks are counted by kernel_get_ticks()
+uint32_t timer_ms_to_ticks(uint32_t ms);
+
+// Run fn(ctx) from the timer's tasklet after at least delay_ms. Re-adding
+// a pending timer moves it. Callbacks run with interrupts enabled and
+// may add or cancel timers, including their own. Timers may also be
+// added from interrupt handlers.
+void timer_add(struct timer* timer, uint32_t delay_ms, timer_fn_t fn, void* ctx);
+
+// Returns false if the timer was not pending
+bool timer_cancel(struct timer* timer);
+bool timer_pending(const struct timer* timer);
+
+// Halt until at least ms have passed; needs interrupts enabled, so not
+// for handlers, tasklets or timer callbacks
+void sleep_ms(uint32_t ms);
+
+// Tickless idle. With interrupts disabled and nothing to do, enter
+// trades the periodic tick for one interrupt at the next timer deadline;
+// exit, called once the CPU is woken, catches the tick count up and
+// restores the periodic tick. kernel_get_ticks() lags only inside the
+// interrupt handler that ends the idle period.
+void timer_idle_enter(void);
+void timer_idle_exit(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TIMER_H
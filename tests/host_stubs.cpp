@@ -0,0 +1,45 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <stdint.h>
+
+// Kernel services the code under test depends on, as in bench/
+
+extern "C" void terminal_write_string(const char* data) {
+    fputs(data, stdout);
+}
+
+extern "C" void serial_write_string(const char* data) {
+    fputs(data, stdout);
+}
+
+extern "C" uint64_t clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// The kernel version divides with divl
+extern "C" uint64_t clock_div_u64(uint64_t n, uint32_t d, uint32_t* remainder) {
+    if (remainder) {
+        *remainder = n % d;
+    }
+    return n / d;
+}
+
+// Page allocations left before page_alloc() fails; negative for no limit
+int page_alloc_budget = -1;
+
+extern "C" void* page_alloc(void) {
+    if (page_alloc_budget == 0) {
+        return nullptr;
+    }
+    if (page_alloc_budget > 0) {
+        page_alloc_budget--;
+    }
+    return aligned_alloc(4096, 4096);
+}
+
+extern "C" void page_free(void* page) {
+    free(page);
+}
@@ -0,0 +1,167 @@
+#include <gtest/gtest.h>
+#include <string.h>
+#include <vector>
+#include "../kernel/aio.h"
+#include "../kernel/filesystem.h"
+
+class AioTest : public testing::Test {
+protected:
+    struct io_ring ring;
+
+    void SetUp() override {
+        filesystem_init();
+    }
+
+    void TearDown() override {
+        io_ring_destroy(&ring);
+    }
+
+    void submit_nops(uint64_t first, unsigned count) {
+        for (unsigned i = 0; i < count; i++) {
+            struct io_sqe* sqe = io_get_sqe(&ring);
+            ASSERT_NE(sqe, nullptr);
+            sqe->opcode = IO_OP_NOP;
+            sqe->user_data = first + i;
+        }
+        EXPECT_EQ(io_submit(&ring), (int)count);
+    }
+
+    unsigned completions() {
+        return ring.cq_tail - ring.cq_head;
+    }
+
+    // Consume count completions, checking they arrive in order
+    void expect_completions(uint64_t first, unsigned count) {
+        for (unsigned i = 0; i < count; i++) {
+            struct io_cqe* cqe = io_peek_cqe(&ring);
+            ASSERT_NE(cqe, nullptr);
+            EXPECT_EQ(cqe->user_data, first + i);
+            EXPECT_EQ(cqe->result, 0);
+            io_cqe_seen(&ring);
+        }
+    }
+};
+
+TEST_F(AioTest, RejectsBadSizes) {
+    ASSERT_EQ(io_ring_init(&ring, 4), 0);
+    struct io_ring bad;
+    EXPECT_EQ(io_ring_init(&bad, 0), -1);
+    EXPECT_EQ(io_ring_init(&bad, 6), -1);
+}
+
+TEST_F(AioTest, IndicesWrapAround) {
+    ASSERT_EQ(io_ring_init(&ring, 4), 0);
+    ring.sq_prepared = ring.sq_head = ring.sq_tail = 0xFFFFFFFE;
+    ring.cq_head = ring.cq_tail = 0xFFFFFFFD;
+
+    uint64_t next = 0;
+    for (int round = 0; round < 50; round++) {
+        unsigned count = 1 + round % 4;
+        submit_nops(next, count);
+        aio_poll();
+        EXPECT_EQ(completions(), count);
+        expect_completions(next, count);
+        next += count;
+    }
+    EXPECT_LT(ring.sq_head, 0x100u);   // Wrapped
+    EXPECT_EQ(io_peek_cqe(&ring), nullptr);
+}
+
+TEST_F(AioTest, FullSubmissionRing) {
+    ASSERT_EQ(io_ring_init(&ring, 4), 0);
+    submit_nops(0, 4);
+    EXPECT_EQ(io_get_sqe(&ring), nullptr);
+    aio_poll();
+    EXPECT_NE(io_get_sqe(&ring), nullptr);
+}
+
+TEST_F(AioTest, FullCompletionRingHoldsBack) {
+    ASSERT_EQ(io_ring_init(&ring, 4), 0);   // Eight completion entries
+    submit_nops(0, 4);
+    aio_poll();
+    submit_nops(4, 4);
+    aio_poll();
+    EXPECT_EQ(completions(), 8u);
+
+    // No room for more: nothing is serviced and the ring doesn't count
+    // as work that keeps the CPU awake
+    submit_nops(8, 4);
+    aio_poll();
+    EXPECT_EQ(completions(), 8u);
+    EXPECT_EQ(ring.sq_head, 8u);
+    EXPECT_FALSE(aio_pending());
+
+    // Each consumed completion makes room for one more
+    expect_completions(0, 1);
+    EXPECT_TRUE(aio_pending());
+    aio_poll();
+    EXPECT_EQ(ring.sq_head, 9u);
+    EXPECT_FALSE(aio_pending());
+
+    expect_completions(1, 8);
+    aio_poll();
+    expect_completions(9, 3);
+    EXPECT_FALSE(aio_pending());
+}
+
+TEST_F(AioTest, BatchSplitsAcrossPolls) {
+    ASSERT_EQ(io_ring_init(&ring, 2 * AIO_BATCH), 0);
+    submit_nops(0, 2 * AIO_BATCH);
+    EXPECT_TRUE(aio_pending());
+
+    aio_poll();
+    EXPECT_EQ(completions(), (unsigned)AIO_BATCH);
+    EXPECT_TRUE(aio_pending());
+
+    aio_poll();
+    EXPECT_EQ(completions(), 2u * AIO_BATCH);
+    EXPECT_FALSE(aio_pending());
+    expect_completions(0, 2 * AIO_BATCH);
+}
+
+TEST_F(AioTest, WriteCreatesFileThenLaterRequestsFindIt) {
+    ASSERT_EQ(io_ring_init(&ring, 8), 0);
+    char first[] = "hello";
+    char second[] = " world";
+    char readback[16] = {};
+
+    // The first write creates the file; the next two look it up again
+    // instead of using the miss cached before the create
+    struct io_sqe* sqe = io_get_sqe(&ring);
+    *sqe = { IO_OP_WRITE, "created", first, 0, 5, 1 };
+    sqe = io_get_sqe(&ring);
+    *sqe = { IO_OP_WRITE, "created", second, 5, 6, 2 };
+    sqe = io_get_sqe(&ring);
+    *sqe = { IO_OP_READ, "created", readback, 0, sizeof(readback), 3 };
+    sqe = io_get_sqe(&ring);
+    *sqe = { IO_OP_READ, "missing", readback, 0, sizeof(readback), 4 };
+    io_submit(&ring);
+    aio_poll();
+
+    const int32_t expected[] = { 5, 6, 11, -1 };
+    for (unsigned i = 0; i < 4; i++) {
+        struct io_cqe* cqe = io_peek_cqe(&ring);
+        ASSERT_NE(cqe, nullptr);
+        EXPECT_EQ(cqe->user_data, i + 1);
+        EXPECT_EQ(cqe->result, expected[i]) << "request " << i + 1;
+        io_cqe_seen(&ring);
+    }
+    EXPECT_STREQ(readback, "hello world");
+    EXPECT_EQ(file_get_size("created"), 11u);
+}
+
+TEST_F(AioTest, WaitWithNothingInFlight) {
+    ASSERT_EQ(io_ring_init(&ring, 4), 0);
+    EXPECT_EQ(io_wait_cqe(&ring), nullptr);
+
+    // Prepared but unsubmitted entries are not in flight either
+    io_get_sqe(&ring)->user_data = 7;
+    EXPECT_EQ(io_wait_cqe(&ring), nullptr);
+
+    io_submit(&ring);
+    struct io_cqe* cqe = io_wait_cqe(&ring);
+    ASSERT_NE(cqe, nullptr);
+    EXPECT_EQ(cqe->user_data, 7u);
+    io_cqe_seen(&ring);
+    EXPECT_EQ(io_wait_cqe(&ring), nullptr);
+}
@@ -0,0 +1,62 @@
+#include <gtest/gtest.h>
+#include <vector>
+
+// Included so both the instruction and the table paths can be driven
+#include "../kernel/crc32c.cpp"
+
+static const char check_input[] = "123456789";
+static const uint32_t check_value = 0xE3069283;
+
+static std::vector<uint8_t> test_data(size_t size) {
+    std::vector<uint8_t> data(size);
+    uint32_t state = 1;
+    for (size_t i = 0; i < size; i++) {
+        state = state * 1103515245 + 12345;
+        data[i] = (uint8_t)(state >> 16);
+    }
+    return data;
+}
+
+TEST(Crc32cTest, CheckValue) {
+    EXPECT_EQ(crc32c(check_input, 9), check_value);
+}
+
+TEST(Crc32cTest, SoftwareCheckValue) {
+    build_tables();
+    EXPECT_EQ(~crc32c_software(0xFFFFFFFF, (const uint8_t*)check_input, 9), check_value);
+}
+
+TEST(Crc32cTest, HardwareCheckValue) {
+    if (!__builtin_cpu_supports("sse4.2")) {
+        GTEST_SKIP() << "no SSE4.2 crc32 instruction";
+    }
+    EXPECT_EQ(~crc32c_hardware(0xFFFFFFFF, (const uint8_t*)check_input, 9), check_value);
+}
+
+TEST(Crc32cTest, PathsAgree) {
+    if (!__builtin_cpu_supports("sse4.2")) {
+        GTEST_SKIP() << "no SSE4.2 crc32 instruction";
+    }
+    build_tables();
+    std::vector<uint8_t> data = test_data(4096 + 64);
+
+    // Every tail length and alignment the two loops split differently
+    for (size_t offset = 0; offset < 8; offset++) {
+        for (size_t length = 0; length <= 64; length++) {
+            const uint8_t* p = data.data() + offset;
+            EXPECT_EQ(crc32c_software(0xFFFFFFFF, p, length),
+                      crc32c_hardware(0xFFFFFFFF, p, length))
+                << "offset " << offset << " length " << length;
+        }
+    }
+    EXPECT_EQ(crc32c_software(0xFFFFFFFF, data.data(), 4096),
+              crc32c_hardware(0xFFFFFFFF, data.data(), 4096));
+}
+
+TEST(Crc32cTest, UpdateContinues) {
+    std::vector<uint8_t> data = test_data(1000);
+    uint32_t crc = 0xFFFFFFFF;
+    crc = crc32c_update(crc, data.data(), 333);
+    crc = crc32c_update(crc, data.data() + 333, data.size() - 333);
+    EXPECT_EQ(~crc, crc32c(data.data(), data.size()));
+}
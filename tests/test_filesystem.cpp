@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "../kernel/filesystem.h"
+
+extern int page_alloc_budget;
+
+class FilesystemTest : public testing::Test {
+protected:
+    void SetUp() override {
+        filesystem_init();
+    }
+
+    static std::vector<uint8_t> pattern(size_t size, uint8_t seed) {
+        std::vector<uint8_t> data(size);
+        for (size_t i = 0; i < size; i++) {
+            data[i] = (uint8_t)(seed + i * 7 + i / 251);
+        }
+        return data;
+    }
+
+    static std::vector<uint8_t> contents(const char* name) {
+        std::vector<uint8_t> data(MAX_FILE_SIZE);
+        size_t size = 0;
+        EXPECT_EQ(read_file(name, data.data(), &size), 0);
+        data.resize(size);
+        return data;
+    }
+
+    // Overwrite [offset, offset + length) in both the file and the model
+    static void write_both(const char* name, std::vector<uint8_t>& model,
+                           size_t offset, size_t length, uint8_t seed) {
+        std::vector<uint8_t> data = pattern(length, seed);
+        ASSERT_EQ(write_file_range(name, offset, data.data(), length), (int)length);
+        if (model.size() < offset + length) {
+            model.resize(offset + length, 0);
+        }
+        std::copy(data.begin(), data.end(), model.begin() + offset);
+    }
+};
+
+TEST_F(FilesystemTest, RangeWritesAtBlockEdges) {
+    for (bool compressed : { false, true }) {
+        const char* name = compressed ? "packed" : "raw";
+        std::vector<uint8_t> model = pattern(3 * FS_BLOCK_SIZE, 1);
+        ASSERT_EQ(write_file(name, model.data(), model.size()), 0);
+        ASSERT_EQ(file_set_compression(name, compressed), 0);
+
+        write_both(name, model, FS_BLOCK_SIZE - 1, 2, 10);                  // Straddles one edge
+        write_both(name, model, FS_BLOCK_SIZE, FS_BLOCK_SIZE, 20);          // Exactly one block
+        write_both(name, model, FS_BLOCK_SIZE / 2, 2 * FS_BLOCK_SIZE, 30);  // Spans three blocks
+        write_both(name, model, 2 * FS_BLOCK_SIZE - 1, 1, 40);              // Last byte of a block
+        EXPECT_EQ(contents(name), model) << name;
+        delete_file(name);
+    }
+}
+
+TEST_F(FilesystemTest, RangeWriteExtendsWithZeros) {
+    std::vector<uint8_t> model;
+    write_both("grow", model, 0, 10, 1);
+    write_both("grow", model, 2 * FS_BLOCK_SIZE + 5, 10, 2);   // Skips a whole block
+    write_both("grow", model, 3 * FS_BLOCK_SIZE - 3, 6, 3);    // Ends past the old size
+    EXPECT_EQ(file_get_size("grow"), model.size());
+    EXPECT_EQ(contents("grow"), model);
+}
+
+TEST_F(FilesystemTest, RangeReadsAtBlockEdges) {
+    std::vector<uint8_t> model = pattern(2 * FS_BLOCK_SIZE + 100, 5);
+    ASSERT_EQ(write_file("edges", model.data(), model.size()), 0);
+
+    const size_t offsets[] = { 0, FS_BLOCK_SIZE - 1, FS_BLOCK_SIZE, 2 * FS_BLOCK_SIZE - 3 };
+    for (size_t offset : offsets) {
+        std::vector<uint8_t> buffer(FS_BLOCK_SIZE + 2);
+        int read = read_file_range("edges", offset, buffer.data(), buffer.size());
+        size_t expected = std::min(buffer.size(), model.size() - offset);
+        ASSERT_EQ(read, (int)expected) << "offset " << offset;
+        EXPECT_TRUE(std::equal(buffer.begin(), buffer.begin() + expected, model.begin() + offset))
+            << "offset " << offset;
+    }
+
+    // Reads clip at the end of the file
+    uint8_t byte;
+    EXPECT_EQ(read_file_range("edges", model.size(), &byte, 1), 0);
+    EXPECT_EQ(read_file_range("missing", 0, &byte, 1), -1);
+}
+
+TEST_F(FilesystemTest, FailedRangeWriteLeavesFileUnchanged) {
+    std::vector<uint8_t> model = pattern(FS_BLOCK_SIZE + 10, 3);
+    ASSERT_EQ(write_file("atomic", model.data(), model.size()), 0);
+
+    // Room for the first two of the three blocks the write touches
+    std::vector<uint8_t> data = pattern(2 * FS_BLOCK_SIZE, 9);
+    page_alloc_budget = 2;
+    EXPECT_EQ(write_file_range("atomic", FS_BLOCK_SIZE / 2, data.data(), data.size()), -1);
+    page_alloc_budget = -1;
+
+    EXPECT_EQ(file_get_size("atomic"), model.size());
+    EXPECT_EQ(contents("atomic"), model);
+
+    // The same write succeeds once pages are available
+    EXPECT_EQ(write_file_range("atomic", FS_BLOCK_SIZE / 2, data.data(), data.size()),
+              (int)data.size());
+}
+
+TEST_F(FilesystemTest, RangeWriteLimits) {
+    uint8_t byte = 1;
+    EXPECT_EQ(write_file_range("limit", MAX_FILE_SIZE - 1, &byte, 1), 1);
+    EXPECT_EQ(file_get_size("limit"), (size_t)MAX_FILE_SIZE);
+    EXPECT_EQ(write_file_range("limit", MAX_FILE_SIZE, &byte, 1), -1);
+    EXPECT_EQ(fs_checksum_errors(), 0u);
+}
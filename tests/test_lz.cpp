@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "../kernel/lz.h"
+
+// Text-like data with repeats, plus a slow drift so matches vary
+static std::vector<uint8_t> compressible(size_t size) {
+    static const char text[] = "int main() { return 0; }\n";
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; i++) {
+        data[i] = (uint8_t)(text[i % (sizeof(text) - 1)] + i / 997);
+    }
+    return data;
+}
+
+static std::vector<uint8_t> incompressible(size_t size) {
+    std::vector<uint8_t> data(size);
+    uint32_t state = 0x12345678;
+    for (size_t i = 0; i < size; i++) {
+        state = state * 1664525 + 1013904223;
+        data[i] = (uint8_t)(state >> 24);
+    }
+    return data;
+}
+
+static void expect_round_trip(const std::vector<uint8_t>& data) {
+    std::vector<uint8_t> packed(LZ_COMPRESS_BOUND(data.size()));
+    size_t packed_size = lz_compress(data.data(), data.size(), packed.data(), packed.size());
+    ASSERT_GT(packed_size, 0u) << "size " << data.size();
+    ASSERT_LE(packed_size, packed.size());
+
+    std::vector<uint8_t> unpacked(data.size() + 1);
+    int unpacked_size = lz_decompress(packed.data(), packed_size, unpacked.data(), unpacked.size());
+    ASSERT_EQ(unpacked_size, (int)data.size());
+    unpacked.resize(data.size());
+    EXPECT_EQ(unpacked, data) << "size " << data.size();
+}
+
+// Sizes around the minimum match limits, a file block and the largest input
+static const size_t edge_sizes[] = {
+    1, 4, 5, 11, 12, 13, 16, 255, 256, 4095, 4096, 4097, 65535, LZ_MAX_INPUT
+};
+
+TEST(LzTest, CompressibleRoundTrip) {
+    for (size_t size : edge_sizes) {
+        expect_round_trip(compressible(size));
+    }
+}
+
+TEST(LzTest, CompressibleDataShrinks) {
+    std::vector<uint8_t> data = compressible(4096);
+    std::vector<uint8_t> packed(LZ_COMPRESS_BOUND(data.size()));
+    size_t packed_size = lz_compress(data.data(), data.size(), packed.data(), packed.size());
+    EXPECT_GT(packed_size, 0u);
+    EXPECT_LT(packed_size, data.size() / 2);
+}
+
+TEST(LzTest, IncompressibleRoundTrip) {
+    for (size_t size : edge_sizes) {
+        expect_round_trip(incompressible(size));
+    }
+}
+
+TEST(LzTest, LongRunsRoundTrip) {
+    // Overlapping matches with offsets below four
+    for (size_t period = 1; period <= 5; period++) {
+        std::vector<uint8_t> data(4096);
+        for (size_t i = 0; i < data.size(); i++) {
+            data[i] = (uint8_t)(i % period);
+        }
+        expect_round_trip(data);
+    }
+}
+
+TEST(LzTest, EmptyInput) {
+    uint8_t empty = 0;
+    uint8_t packed[16];
+    uint8_t unpacked[1];
+    size_t packed_size = lz_compress(&empty, 0, packed, sizeof(packed));
+    ASSERT_GT(packed_size, 0u);
+    EXPECT_EQ(lz_decompress(packed, packed_size, unpacked, sizeof(unpacked)), 0);
+}
+
+TEST(LzTest, RejectsOversizedInput) {
+    std::vector<uint8_t> data = compressible(LZ_MAX_INPUT + 1);
+    std::vector<uint8_t> packed(LZ_COMPRESS_BOUND(data.size()));
+    EXPECT_EQ(lz_compress(data.data(), data.size(), packed.data(), packed.size()), 0u);
+}
+
+TEST(LzTest, ReportsOutputOverflow) {
+    std::vector<uint8_t> data = incompressible(4096);
+    std::vector<uint8_t> packed(data.size() / 2);
+    EXPECT_EQ(lz_compress(data.data(), data.size(), packed.data(), packed.size()), 0u);
+}
+
+TEST(LzTest, RejectsShortOrTruncatedOutput) {
+    std::vector<uint8_t> data = compressible(4096);
+    std::vector<uint8_t> packed(LZ_COMPRESS_BOUND(data.size()));
+    size_t packed_size = lz_compress(data.data(), data.size(), packed.data(), packed.size());
+    ASSERT_GT(packed_size, 0u);
+
+    std::vector<uint8_t> unpacked(data.size());
+    EXPECT_EQ(lz_decompress(packed.data(), packed_size, unpacked.data(), data.size() - 1), -1);
+    EXPECT_EQ(lz_decompress(packed.data(), packed_size - 1, unpacked.data(), unpacked.size()), -1);
+}
+
+TEST(LzTest, RejectsOffsetBeforeOutput) {
+    // No literals, then a match reaching one byte before the start
+    const uint8_t bad[] = { 0x00, 0x01, 0x00 };
+    uint8_t out[32];
+    EXPECT_EQ(lz_decompress(bad, sizeof(bad), out, sizeof(out)), -1);
+}
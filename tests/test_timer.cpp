@@ -0,0 +1,207 @@
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <vector>
+
+// Host stand-ins for the port and interrupt-flag helpers. Defining IO_H
+// keeps kernel/io.h's privileged instructions out of this file.
+#define IO_H
+static inline void outb(uint16_t, uint8_t) {}
+static inline uint8_t inb(uint16_t) { return 0; }
+static inline uint64_t rdtsc(void) { return 0; }
+static inline uint32_t irq_save(void) { return 0; }
+static inline void irq_restore(uint32_t) {}
+static inline void irq_disable(void) {}
+static inline void irq_enable(void) {}
+static inline void cpu_idle(void) {}
+
+// Included so tests can place the tick next to a wrap
+#include "../kernel/timer.cpp"
+
+// Interrupt and APIC services timer.cpp depends on. The APIC timer is
+// reported missing, so the tick takes the PIT path.
+static interrupt_handler_t tick_handler = nullptr;
+static struct tasklet* scheduled = nullptr;
+
+extern "C" int register_interrupt_handler(uint8_t, interrupt_handler_t handler, void*) {
+    tick_handler = handler;
+    return 0;
+}
+extern "C" void irq_set_masked(unsigned, bool) {}
+extern "C" void interrupt_record_latency(uint32_t) {}
+extern "C" void tasklet_init(struct tasklet* tasklet, void (*fn)(void* ctx), void* ctx) {
+    tasklet->fn = fn;
+    tasklet->ctx = ctx;
+    tasklet->scheduled = false;
+}
+extern "C" void tasklet_schedule(struct tasklet* tasklet) {
+    scheduled = tasklet;
+}
+extern "C" bool lapic_timer_start(uint32_t, uint8_t) { return false; }
+extern "C" uint32_t lapic_timer_period(void) { return 0; }
+extern "C" void lapic_timer_periodic(uint32_t) {}
+extern "C" void lapic_timer_oneshot(uint32_t) {}
+extern "C" uint32_t lapic_timer_remaining(void) { return 0; }
+extern "C" void lapic_timer_mask(void) {}
+extern "C" bool lapic_timer_pending(void) { return false; }
+extern "C" uint32_t clock_tsc_khz(void) { return 0; }
+
+struct fired_timer {
+    struct timer timer;
+    uint32_t fired_at;
+    unsigned fire_count;
+};
+
+static void record_fire(void* ctx) {
+    fired_timer* t = (fired_timer*)ctx;
+    t->fired_at = kernel_get_ticks();
+    t->fire_count++;
+}
+
+class TimerTest : public testing::Test {
+protected:
+    // Empty wheel with the next tick at start
+    void reset(uint32_t start) {
+        if (!tick_handler) {
+            timer_init();
+        }
+        memset(wheel_root, 0, sizeof(wheel_root));
+        memset(wheel_levels, 0, sizeof(wheel_levels));
+        tick = start - 1;
+        wheel_tick = start;
+        scheduled = nullptr;
+    }
+
+    // One timer interrupt, then its tasklet as the interrupt exit would
+    void run_tick() {
+        tick_handler(nullptr, nullptr);
+        if (scheduled) {
+            struct tasklet* tasklet = scheduled;
+            scheduled = nullptr;
+            tasklet->fn(tasklet->ctx);
+        }
+    }
+
+    void run_until(uint32_t target) {
+        while ((int32_t)(target - kernel_get_ticks()) > 0) {
+            run_tick();
+        }
+    }
+
+    // Re-adding keeps the wheel links, which timer_add() needs to move it
+    void add(fired_timer* t, uint32_t delay_ticks) {
+        t->fired_at = 0;
+        t->fire_count = 0;
+        timer_add(&t->timer, delay_ticks * 1000 / TIMER_HZ, record_fire, t);
+    }
+};
+
+TEST_F(TimerTest, FiresOnItsTick) {
+    reset(1000);
+    fired_timer t = {};
+    add(&t, 5);
+    uint32_t expires = t.timer.expires;
+    EXPECT_EQ(expires, kernel_get_ticks() + 6);
+    EXPECT_TRUE(timer_pending(&t.timer));
+
+    run_until(expires - 1);
+    EXPECT_EQ(t.fire_count, 0u);
+    run_tick();
+    EXPECT_EQ(t.fire_count, 1u);
+    EXPECT_EQ(t.fired_at, expires);
+    EXPECT_FALSE(timer_pending(&t.timer));
+}
+
+TEST_F(TimerTest, CancelledTimerDoesNotFire) {
+    reset(1000);
+    fired_timer keep = {}, cancel = {};
+    add(&keep, 3);
+    add(&cancel, 3);
+    EXPECT_TRUE(timer_cancel(&cancel.timer));
+    EXPECT_FALSE(timer_cancel(&cancel.timer));
+
+    run_until(kernel_get_ticks() + 10);
+    EXPECT_EQ(keep.fire_count, 1u);
+    EXPECT_EQ(cancel.fire_count, 0u);
+    EXPECT_FALSE(timer_cancel(&keep.timer));
+}
+
+TEST_F(TimerTest, ReAddMovesTimer) {
+    reset(1000);
+    fired_timer t = {};
+    add(&t, 2);
+    timer_add(&t.timer, 20 * 1000 / TIMER_HZ, record_fire, &t);
+    uint32_t expires = t.timer.expires;
+
+    run_until(expires + 5);
+    EXPECT_EQ(t.fire_count, 1u);
+    EXPECT_EQ(t.fired_at, expires);
+}
+
+TEST_F(TimerTest, CascadesAcrossRootWrap) {
+    // Start just short of a root wrap, with delays landing in each level
+    reset(WHEEL_ROOT_SIZE * 7 - 3);
+    const uint32_t delays[] = {
+        1, 2, 3, 4, 255, 256, 257, 1000, WHEEL_ROOT_SIZE * WHEEL_LEVEL_SIZE + 1, 70000
+    };
+    const size_t count = sizeof(delays) / sizeof(delays[0]);
+    std::vector<fired_timer> timers(count);
+    for (size_t i = 0; i < count; i++) {
+        add(&timers[i], delays[i]);
+    }
+
+    run_until(timers[count - 1].timer.expires);
+    for (size_t i = 0; i < count; i++) {
+        EXPECT_EQ(timers[i].fire_count, 1u) << "delay " << delays[i];
+        EXPECT_EQ(timers[i].fired_at, timers[i].timer.expires) << "delay " << delays[i];
+    }
+}
+
+TEST_F(TimerTest, CascadesAcrossCounterWrap) {
+    reset(0xFFFFFFFFu - 300);
+    fired_timer near = {}, far = {};
+    add(&near, 200);
+    add(&far, 5000);
+    EXPECT_LT(far.timer.expires, near.timer.expires);  // Wrapped
+
+    run_until(far.timer.expires);
+    EXPECT_EQ(near.fired_at, near.timer.expires);
+    EXPECT_EQ(far.fired_at, far.timer.expires);
+    EXPECT_EQ(far.fire_count, 1u);
+}
+
+TEST_F(TimerTest, RandomizedAgainstExpiry) {
+    reset(0xFFFF0000u);
+    const size_t count = 500;
+    std::vector<fired_timer> timers(count);
+    std::vector<uint32_t> due(count, 0);
+    uint32_t state = 42;
+    auto next = [&state]() {
+        state = state * 1664525 + 1013904223;
+        return state >> 8;
+    };
+
+    for (int step = 0; step < 100000; step++) {
+        size_t i = next() % count;
+        if (next() % 3 == 0) {
+            uint32_t delay = next() % 5 == 0 ? next() % 200000 : next() % 500;
+            add(&timers[i], delay);
+            due[i] = timers[i].timer.expires;
+        } else if (next() % 5 == 0 && timer_cancel(&timers[i].timer)) {
+            due[i] = 0;
+        }
+
+        run_tick();
+        uint32_t now = kernel_get_ticks();
+        for (size_t k = 0; k < count; k++) {
+            if (!due[k]) {
+                continue;
+            }
+            if (timers[k].fire_count) {
+                ASSERT_EQ(timers[k].fired_at, due[k]) << "timer " << k;
+                due[k] = 0;
+            } else {
+                ASSERT_LE((int32_t)(now - due[k]), 0) << "timer " << k << " late";
+            }
+        }
+    }
+}